@@ -1,6 +1,7 @@
 #pragma once
 
 #include <arisen/asset.hpp>
+#include <arisen/binary_extension.hpp>
 #include <arisen/privileged.hpp>
 #include <arisen/singleton.hpp>
 #include <arisen/system.hpp>
@@ -8,8 +9,12 @@
 
 #include <arisen.system/exchange_state.hpp>
 #include <arisen.system/native.hpp>
+#include <arisen.system/producer_pay.hpp>
+#include <arisen.system/producer_schedule.hpp>
+#include <arisen.system/vote_weight.hpp>
 
 #include <deque>
+#include <map>
 #include <optional>
 #include <string>
 #include <type_traits>
@@ -71,6 +76,120 @@ namespace arisensystem {
    static constexpr int64_t  inflation_pay_factor  = 5;                // 20% of the inflation
    static constexpr int64_t  votepay_factor        = 4;                // 25% of the producer pay
    static constexpr uint32_t refund_delay_sec      = 3 * seconds_per_day;
+   static constexpr uint8_t  global_record_version = 6;                // layout version of arisen_global_record
+   static constexpr uint32_t max_ranked_producers  = 30;               // candidates kept in the `prodranking` table
+   static constexpr uint32_t proxy_flushes_per_election = 10;          // pending proxies cast before each election
+   static constexpr uint32_t vote_set_flushes           = 10;          // pending vote sets cast before each election and claim
+
+   static constexpr producer_pay::parameters pay_parameters = {
+      continuous_rate, inflation_pay_factor, votepay_factor, min_pervote_daily_pay, useconds_per_year
+   };
+
+   /**
+    * Global state singletons an action may load, see `action_state_manifest()`.
+    */
+   enum class state_fields : uint32_t {
+      global  = 1,
+      global2 = 2,
+      global3 = 4
+   };
+
+   static constexpr uint32_t unlisted_manifest = ~uint32_t(0); // `action_state_manifest()` of an action without an entry
+
+   /**
+    * Compile-time manifest of the global state singletons each system contract action may load.
+    *
+    * @details The manifest is installed by the contract entry point and enforced by the global state
+    * accessors, so an action that starts reading state it does not declare fails instead of silently
+    * paying for an extra database lookup. Actions that may reach vote and producer pay accounting are
+    * allowed to load everything. Every action of the contract must have an entry, the contract does not
+    * compile if a dispatched action is left to the `unlisted_manifest` default.
+    *
+    * @param action - the action being dispatched
+    *
+    * @return bitmask of `state_fields`
+    */
+   constexpr uint32_t action_state_manifest( const name& action ) {
+      constexpr uint32_t global  = static_cast<uint32_t>(state_fields::global);
+      constexpr uint32_t global2 = static_cast<uint32_t>(state_fields::global2);
+      constexpr uint32_t global3 = static_cast<uint32_t>(state_fields::global3);
+
+      switch( action.value ) {
+         case "setpriv"_n.value:
+         case "setalimits"_n.value:
+         case "setacctram"_n.value:
+         case "setacctnet"_n.value:
+         case "setacctcpu"_n.value:
+         case "activate"_n.value:
+         case "bidrefund"_n.value:
+         case "refund"_n.value:
+         case "deposit"_n.value:
+         case "setcom"_n.value:
+         case "cnclcomorder"_n.value:
+         case "fundcpuloan"_n.value:
+         case "fundnetloan"_n.value:
+         case "defcpuloan"_n.value:
+         case "defnetloan"_n.value:
+         case "migratevotes"_n.value:
+            return 0;
+         case "rmvproducer"_n.value:
+         case "unregprod"_n.value:
+         case "setram"_n.value:
+         case "setparams"_n.value:
+         case "setschedord"_n.value:
+         case "setvotedelta"_n.value:
+         case "bidname"_n.value:
+            return global;
+         case "updtrevision"_n.value:
+            return global2;
+         case "setramrate"_n.value:
+         case "buyram"_n.value:
+         case "buyrambytes"_n.value:
+         case "buyrambatch"_n.value:
+         case "sellram"_n.value:
+            return global | global2;
+         case "onblock"_n.value:
+         case "newaccount"_n.value:
+         case "updateauth"_n.value:
+         case "deleteauth"_n.value:
+         case "linkauth"_n.value:
+         case "unlinkauth"_n.value:
+         case "canceldelay"_n.value:
+         case "onerror"_n.value:
+         case "setabi"_n.value:
+         case "setcode"_n.value:
+         case "init"_n.value:
+         case "mergeglobals"_n.value:
+         case "migrateprods"_n.value:
+         case "delegatebw"_n.value:
+         case "undelegatebw"_n.value:
+         case "regproducer"_n.value:
+         case "voteproducer"_n.value:
+         case "bulkvote"_n.value:
+         case "regproxy"_n.value:
+         case "flushproxies"_n.value:
+         case "flushvotesets"_n.value:
+         case "claimrewards"_n.value:
+         case "settlepay"_n.value:
+         case "claimtostake"_n.value:
+         case "claimtocom"_n.value:
+         case "withdraw"_n.value:
+         case "buycom"_n.value:
+         case "unstaketocom"_n.value:
+         case "sellcom"_n.value:
+         case "rentcpu"_n.value:
+         case "rentnet"_n.value:
+         case "updatecom"_n.value:
+         case "comexec"_n.value:
+         case "consolidate"_n.value:
+         case "mvtosavings"_n.value:
+         case "mvfrsavings"_n.value:
+         case "closecom"_n.value:
+            return global | global2 | global3;
+         default:
+            return unlisted_manifest;
+      }
+   }
 
 
    /**
@@ -193,8 +312,142 @@ namespace arisensystem {
       RSNLIB_SERIALIZE( arisen_global_state3, (last_vpay_state_update)(total_vpay_share_change_rate) )
    };
 
+   /**
+    * Fixed-point counterparts of the double precision vote totals of the global state, see `vote_weight.hpp`.
+    *
+    * @details Only stored in the consolidated global state record; while the legacy singletons are in use
+    * they are derived from the double precision fields when an action loads them.
+    */
+   struct fixed_vote_totals {
+      int128_t producer_vote_weight   = 0; ///< exact `total_producer_vote_weight`
+      int128_t producer_votepay_share = 0; ///< exact `total_producer_votepay_share`
+      int128_t vpay_share_change_rate = 0; ///< exact `total_vpay_share_change_rate`
+
+      RSNLIB_SERIALIZE( fixed_vote_totals, (producer_vote_weight)(producer_votepay_share)(vpay_share_change_rate) )
+   };
+
+   /**
+    * State of the producer election run by `update_elected_producers`.
+    *
+    * @details Lets the election skip the scan of the producers while nothing that can change the elected
+    * producers has happened, and skip proposing a schedule identical to the last one.
+    */
+   struct election_state {
+      checksum256 schedule_digest;        ///< sha256 of the producers and keys of the last proposed schedule
+      int128_t    min_elected_votes = 0;  ///< votes of the last of 21 elected producers, 0 when fewer were elected
+      bool        ranking_changed = true; ///< votes, keys or activity of a producer that may be elected changed since
+
+      RSNLIB_SERIALIZE( election_state, (schedule_digest)(min_elected_votes)(ranking_changed) )
+   };
+
+   /**
+    * Parameters of the proposed producer schedules, set with `setschedord`.
+    */
+   struct schedule_parameters {
+      uint8_t order = producer_schedule::by_name; ///< ordering of the elected producers, see `producer_schedule.hpp`
+
+      RSNLIB_SERIALIZE( schedule_parameters, (order) )
+   };
+
+   /**
+    * Thresholds below which stake changes of a voter are not cast right away, set with `setvotedelta`.
+    *
+    * @details Stake changes of a voter are accumulated in `pendstakes`, see `voter_pending_stake`, while they stay below
+    * every threshold that is set, and cast with the voter's votes once they reach one of them or the voter
+    * votes again. Both thresholds are 0, disabled, by default, so every stake change is cast right away.
+    */
+   struct vote_debounce_parameters {
+      int64_t  min_stake_delta    = 0; ///< smallest stake change cast right away, in core token units
+      uint16_t min_stake_delta_bp = 0; ///< smallest stake change cast right away, in basis points of the voted stake
+
+      RSNLIB_SERIALIZE( vote_debounce_parameters, (min_stake_delta)(min_stake_delta_bp) )
+   };
+
+   /**
+    * Highest open name auction, mirrored from the `highbid` index of the `namebids` table.
+    *
+    * @details Kept up to date by `bidname`, so that the name closing check of `onblock` compares cached values
+    * and only opens the auction table to close a name. The mirror is `stale` when the highest auction is not
+    * known, after a name closed and in records written before the mirror existed; the index is read then.
+    */
+   struct name_auction_state {
+      name       newname;        ///< name of the highest open auction, empty when there is none
+      name       high_bidder;
+      int64_t    high_bid = 0;
+      time_point last_bid_time;
+      bool       stale = true;
+
+      RSNLIB_SERIALIZE( name_auction_state, (newname)(high_bidder)(high_bid)(last_bid_time)(stale) )
+   };
+
+   /**
+    * Progress of the daily producer pay settlement, see `settlepay`.
+    */
+   struct payout_state {
+      time_point last_settlement;   ///< start of the last settlement, when it funded the pay buckets
+      name       next_producer;     ///< first producer the running settlement has not visited yet
+      bool       settling = false;  ///< the last settlement has not visited all producers yet
+
+      RSNLIB_SERIALIZE( payout_state, (last_settlement)(next_producer)(settling) )
+   };
+
+   /**
+    * Defines the consolidated global state record which replaces the `global`, `global2` and `global3` singletons.
+    *
+    * @details All parts of the global state are read and written as a single row. Chains initialized before
+    * this record existed keep using the legacy singletons until the `mergeglobals` action moves them over.
+    * Fields added in the future are appended at the end as `binary_extension`s and `version` is bumped.
+    *
+    * Version history:
+    * - 0: `gstate`, `gstate2` and `gstate3`
+    * - 1: `vote_totals`
+    * - 2: `election`
+    * - 3: `schedule`
+    * - 4: `vote_debounce`
+    * - 5: `name_auction`
+    * - 6: `payout`
+    */
+   struct [[arisen::table("globalstate"), arisen::contract("arisen.system")]] arisen_global_record {
+      uint8_t              version = 0;
+      arisen_global_state  gstate;
+      arisen_global_state2 gstate2;
+      arisen_global_state3 gstate3;
+      arisen::binary_extension<fixed_vote_totals> vote_totals;
+      arisen::binary_extension<election_state>    election;
+      arisen::binary_extension<schedule_parameters> schedule;
+      arisen::binary_extension<vote_debounce_parameters> vote_debounce;
+      arisen::binary_extension<name_auction_state>       name_auction;
+      arisen::binary_extension<payout_state>             payout;
+
+      RSNLIB_SERIALIZE( arisen_global_record, (version)(gstate)(gstate2)(gstate3)(vote_totals)(election)(schedule)(vote_debounce)
+                        (name_auction)(payout) )
+   };
+
+   /**
+    * Per-vote pay accounting of a producer.
+    *
+    * @details Kept in the producer's `producer_stats` row, which every change of the producer's votes modifies
+    * anyway, so that votes do not have to write a second row. It supersedes the `producer_info2` row.
+    */
+   struct producer_votepay {
+      double          votepay_share = 0;         ///< same as `producer_info2::votepay_share`
+      time_point      last_votepay_share_update; ///< time at which `votepay_share` was last settled
+      int128_t        fixed_votepay_share = 0;   ///< exact `votepay_share`, see `vote_weight.hpp`
+
+      int128_t share()const { return fixed_votepay_share; }
+      void set_share( int128_t share ) {
+         fixed_votepay_share = share;
+         votepay_share       = vote_weight::share_to_double( share );
+      }
+
+      RSNLIB_SERIALIZE( producer_votepay, (votepay_share)(last_votepay_share_update)(fixed_votepay_share) )
+   };
+
    /**
     * Defines `producer_info` structure to be stored in `producer_info` table, added after version 1.0
+    *
+    * @details Superseded by `producer_stats` and `producer_config`, rows are moved over by `migrateprods`
+    * or when the producer is next used.
     */
    struct [[arisen::table, arisen::contract("arisen.system")]] producer_info {
       name                  owner;
@@ -205,29 +458,163 @@ namespace arisensystem {
       uint32_t              unpaid_blocks = 0;
       time_point            last_claim_time;
       uint16_t              location = 0;
+      arisen::binary_extension<int128_t> fixed_total_votes; ///< exact `total_votes`, see `vote_weight.hpp`
+      arisen::binary_extension<producer_votepay> votepay;   ///< per-vote pay accounting, replaces the `producer_info2` row
 
       uint64_t primary_key()const { return owner.value;                             }
       double   by_votes()const    { return is_active ? -total_votes : total_votes;  }
       bool     active()const      { return is_active;                               }
       void     deactivate()       { producer_key = public_key(); is_active = false; }
 
+      int128_t votes()const {
+         return fixed_total_votes.has_value() ? fixed_total_votes.value() : vote_weight::from_double( total_votes );
+      }
+      void set_votes( int128_t votes ) {
+         fixed_total_votes.emplace( votes );
+         total_votes = vote_weight::to_double( votes );
+      }
+
       // explicit serialization macro is not necessary, used here only to improve compilation time
       RSNLIB_SERIALIZE( producer_info, (owner)(total_votes)(producer_key)(is_active)(url)
-                        (unpaid_blocks)(last_claim_time)(location) )
+                        (unpaid_blocks)(last_claim_time)(location)(fixed_total_votes)(votepay) )
+   };
+
+   /**
+    * Frequently updated part of a producer, stored in the `prodstats` table.
+    *
+    * @details Votes, produced blocks and claims only write this fixed size row. The producer key, url and
+    * location, which only change on registration, are kept in `producer_config`. The table has no secondary
+    * index, so a change of votes only rewrites the row; the election reads its candidates from `producer_ranking`.
+    */
+   struct [[arisen::table("prodstats"), arisen::contract("arisen.system")]] producer_stats {
+      name              owner;
+      double            total_votes = 0;
+      int128_t          fixed_total_votes = 0; ///< exact `total_votes`, see `vote_weight.hpp`
+      bool              is_active = true;
+      uint32_t          unpaid_blocks = 0;
+      time_point        last_claim_time;       ///< last `claimrewards`, vote pay stops after `producer_pay::votepay_threshold`
+      time_point        last_pay_time;         ///< last claim or `settlepay` credit, pay is taken at most once a day
+      producer_votepay  votepay;               ///< unset for producers registered before per-vote pay existed
+
+      uint64_t primary_key()const { return owner.value;                             }
+      bool     active()const      { return is_active;                               }
+      bool     eligible()const    { return is_active && fixed_total_votes > 0;      }
+      bool     has_votepay()const { return votepay.last_votepay_share_update != time_point(); }
+
+      int128_t votes()const { return fixed_total_votes; }
+      void set_votes( int128_t votes ) {
+         fixed_total_votes = votes;
+         total_votes       = vote_weight::to_double( votes );
+      }
+
+      RSNLIB_SERIALIZE( producer_stats, (owner)(total_votes)(fixed_total_votes)(is_active)
+                        (unpaid_blocks)(last_claim_time)(last_pay_time)(votepay) )
    };
 
+   /**
+    * Registration data of a producer, stored in the `prodconfig` table, see `producer_stats`.
+    */
+   struct [[arisen::table("prodconfig"), arisen::contract("arisen.system")]] producer_config {
+      name                  owner;
+      arisen::public_key     producer_key; /// a packed public key object
+      std::string           url;
+      uint16_t              location = 0;
+
+      uint64_t primary_key()const { return owner.value; }
+
+      RSNLIB_SERIALIZE( producer_config, (owner)(producer_key)(url)(location) )
+   };
+
+   /**
+    * Candidate of the producer election, with the votes read from its producer row.
+    */
+   struct ranked_producer {
+      name     owner;
+      int128_t votes = 0;
+
+      /// election order, most votes first and ties in name order
+      friend bool operator < ( const ranked_producer& a, const ranked_producer& b ) {
+         return a.votes != b.votes ? a.votes > b.votes : a.owner < b.owner;
+      }
+   };
+
+   /**
+    * The best candidates of the producer election, read by `update_elected_producers` instead of the producer tables.
+    *
+    * @details Holds the names of at most `max_ranked_producers` active producers with votes, in name order;
+    * their votes are read from the producer rows when an election runs. Every producer that is not ranked has
+    * at most `outside_votes`, and every ranked one has at least that many. The row is only written when a
+    * producer crosses `outside_votes`, which rises to the votes of a ranked producer pushed out by a new one,
+    * so votes for a ranked producer that stays above it do not touch it. Once fewer producers than can be
+    * elected are ranked while others may have votes, the ranking is marked `stale` and the next election
+    * rebuilds it from the producer tables.
+    */
+   struct [[arisen::table("prodranking"), arisen::contract("arisen.system")]] producer_ranking {
+      std::vector<name> producers;
+      int128_t          outside_votes = 0;
+      bool              stale = true;   ///< rebuilt by the next election, set until the first one
+
+      RSNLIB_SERIALIZE( producer_ranking, (producers)(outside_votes)(stale) )
+   };
+
+   /**
+    * Blocks produced by the current producer that have not been added to its `unpaid_blocks` yet.
+    *
+    * @details A producer makes its blocks of a round in a row, so `onblock` only counts them in this small
+    * record and adds them to the producer row and to `total_unpaid_blocks` once another producer takes over,
+    * or before rewards are claimed. The record is still written in every block, what is saved is the size
+    * of that write: 12 bytes instead of the producer row with its url and key, and the global state.
+    * Writing only at round boundaries would need the current block number, which `claimrewards` and
+    * `settlepay` cannot read to count the blocks of a round in progress.
+    */
+   struct [[arisen::table("unpaidblocks"), arisen::contract("arisen.system")]] unpaid_blocks_buffer {
+      name     producer;
+      uint32_t blocks = 0;
+
+      RSNLIB_SERIALIZE( unpaid_blocks_buffer, (producer)(blocks) )
+   };
+
+   /**
+    * Producer pay credited by `settlepay` and not withdrawn yet.
+    *
+    * @details The tokens stay in the `arisen.bpay` and `arisen.vpay` accounts until the producer withdraws them
+    * with `claimrewards`.
+    */
+   struct [[arisen::table("paycredits"), arisen::contract("arisen.system")]] pay_credit {
+      name     owner;
+      int64_t  block_pay = 0;   ///< held by `arisen.bpay`
+      int64_t  vote_pay  = 0;   ///< held by `arisen.vpay`
+
+      uint64_t primary_key()const { return owner.value; }
+
+      RSNLIB_SERIALIZE( pay_credit, (owner)(block_pay)(vote_pay) )
+   };
+
+   typedef arisen::multi_index< "paycredits"_n, pay_credit > pay_credits_table;
+
    /**
     * Defines new producer info structure to be stored in new producer info table, added after version 1.3.0
+    *
+    * @details Superseded by `producer_stats::votepay`, rows are moved over together with the `producer_info` rows.
     */
    struct [[arisen::table, arisen::contract("arisen.system")]] producer_info2 {
       name            owner;
       double          votepay_share = 0;
       time_point      last_votepay_share_update;
+      arisen::binary_extension<int128_t> fixed_votepay_share; ///< exact `votepay_share`, see `vote_weight.hpp`
 
       uint64_t primary_key()const { return owner.value; }
 
+      int128_t share()const {
+         return fixed_votepay_share.has_value() ? fixed_votepay_share.value() : vote_weight::share_from_double( votepay_share );
+      }
+      void set_share( int128_t share ) {
+         fixed_votepay_share.emplace( share );
+         votepay_share = vote_weight::share_to_double( share );
+      }
+
       // explicit serialization macro is not necessary, used here only to improve compilation time
-      RSNLIB_SERIALIZE( producer_info2, (owner)(votepay_share)(last_votepay_share_update) )
+      RSNLIB_SERIALIZE( producer_info2, (owner)(votepay_share)(last_votepay_share_update)(fixed_votepay_share) )
    };
 
    /**
@@ -238,6 +625,8 @@ namespace arisensystem {
     * - `proxy` the proxy set by the voter, if any
     * - `producers` the producers approved by this voter if no proxy set
     * - `staked` the amount staked
+    *
+    * Superseded by `voter_info2`, rows are moved over by `migratevotes` or when the voter is next used.
     */
    struct [[arisen::table, arisen::contract("arisen.system")]] voter_info {
       name                owner;     /// the voter
@@ -264,8 +653,30 @@ namespace arisensystem {
       uint32_t            reserved2 = 0;
       arisen::asset        reserved3;
 
+      arisen::binary_extension<int128_t> fixed_last_vote_weight;    ///< exact `last_vote_weight`, see `vote_weight.hpp`
+      arisen::binary_extension<int128_t> fixed_proxied_vote_weight; ///< exact `proxied_vote_weight`
+      arisen::binary_extension<int64_t>  pending_stake;             ///< stake change not cast yet, see `vote_debounce_parameters`
+      arisen::binary_extension<int128_t> pending_proxied_weight;    ///< part of `proxied_vote_weight` not cast yet, see `pending_proxy`
+      arisen::binary_extension<uint64_t> vote_set_id;               ///< `vote_set` holding `producers`, which is then left empty
+
       uint64_t primary_key()const { return owner.value; }
 
+      int128_t weight()const {
+         return fixed_last_vote_weight.has_value() ? fixed_last_vote_weight.value() : vote_weight::from_double( last_vote_weight );
+      }
+      int128_t proxied_weight()const {
+         return fixed_proxied_vote_weight.has_value() ? fixed_proxied_vote_weight.value() : vote_weight::from_double( proxied_vote_weight );
+      }
+      int64_t pending()const {
+         return pending_stake.has_value() ? pending_stake.value() : 0;
+      }
+      int128_t pending_proxied()const {
+         return pending_proxied_weight.has_value() ? pending_proxied_weight.value() : 0;
+      }
+      uint64_t vote_set()const {
+         return vote_set_id.has_value() ? vote_set_id.value() : 0;
+      }
+
       enum class flags1_fields : uint32_t {
          ram_managed = 1,
          net_managed = 2,
@@ -273,7 +684,8 @@ namespace arisensystem {
       };
 
       // explicit serialization macro is not necessary, used here only to improve compilation time
-      RSNLIB_SERIALIZE( voter_info, (owner)(proxy)(producers)(staked)(last_vote_weight)(proxied_vote_weight)(is_proxy)(flags1)(reserved2)(reserved3) )
+      RSNLIB_SERIALIZE( voter_info, (owner)(proxy)(producers)(staked)(last_vote_weight)(proxied_vote_weight)(is_proxy)(flags1)(reserved2)(reserved3)
+                        (fixed_last_vote_weight)(fixed_proxied_vote_weight)(pending_stake)(pending_proxied_weight)(vote_set_id) )
    };
 
    /**
@@ -283,6 +695,140 @@ namespace arisensystem {
     */
    typedef arisen::multi_index< "voters"_n, voter_info >  voters_table;
 
+   /**
+    * Voter row, replaces `voter_info`.
+    *
+    * @details Holds the same information without reserved fields. The weights are the exact values of
+    * `vote_weight.hpp`, the producers voted for are kept in the referenced `vote_set`, and `is_proxy` is one
+    * of the `flags`. The trailing fields are only written once a value is set, together with the ones before
+    * them: an account that only stakes takes 25 bytes, a voter 49 and a proxy 65, so no row is larger than the
+    * 66 bytes of a `voter_info` row without producers. Changes not cast yet are kept in `pendstakes` and
+    * `pendproxies`.
+    */
+   struct [[arisen::table, arisen::contract("arisen.system")]] voter_info2 {
+      name     owner;                      ///< the voter
+      name     proxy;                      ///< the proxy set by the voter, if any
+      int64_t  staked = 0;
+      uint8_t  flags = 0;
+      arisen::binary_extension<uint64_t> vote_set_id;         ///< `vote_set` of the producers voted for, if any
+      arisen::binary_extension<int128_t> last_vote_weight;    ///< the vote weight cast the last time the vote was updated
+      arisen::binary_extension<int128_t> proxied_vote_weight; ///< the total vote weight delegated to this voter as a proxy
+
+      enum class flags_fields : uint8_t {
+         ram_managed = 1,
+         net_managed = 2,
+         cpu_managed = 4,
+         is_proxy    = 8
+      };
+
+      uint64_t primary_key()const { return owner.value; }
+
+      bool     is_proxy()const       { return has_field( flags, flags_fields::is_proxy ); }
+      int128_t weight()const         { return last_vote_weight.has_value() ? last_vote_weight.value() : 0;       }
+      int128_t proxied_weight()const { return proxied_vote_weight.has_value() ? proxied_vote_weight.value() : 0; }
+      uint64_t vote_set()const       { return vote_set_id.has_value() ? vote_set_id.value() : 0;                 }
+      /// votes for producers through a vote set, or for a proxy
+      bool     has_vote()const       { return proxy || vote_set() != 0; }
+
+      void set_weights( int128_t weight, int128_t proxied ) {
+         // an extension is only written after the ones before it
+         if( proxied != 0 || proxied_vote_weight.has_value() )
+            proxied_vote_weight.emplace( proxied );
+         if( weight != 0 || proxied_vote_weight.has_value() || last_vote_weight.has_value() )
+            last_vote_weight.emplace( weight );
+         if( last_vote_weight.has_value() && !vote_set_id.has_value() )
+            vote_set_id.emplace( 0 );
+      }
+      void set_vote_set( uint64_t id ) {
+         if( id != 0 || vote_set_id.has_value() )
+            vote_set_id.emplace( id );
+      }
+
+      RSNLIB_SERIALIZE( voter_info2, (owner)(proxy)(staked)(flags)(vote_set_id)(last_vote_weight)(proxied_vote_weight) )
+   };
+
+   typedef arisen::multi_index< "voters2"_n, voter_info2 >  voters_table2;
+
+   /**
+    * Stake change of a voter not cast yet, see `vote_debounce_parameters`.
+    *
+    * @details Kept out of `voter_info2`, as few voters have one at a time. The row exists while the change is
+    * not 0 and is paid for by the voter.
+    */
+   struct [[arisen::table, arisen::contract("arisen.system")]] voter_pending_stake {
+      name    voter;
+      int64_t stake = 0; ///< stake change not cast yet
+
+      uint64_t primary_key()const { return voter.value; }
+
+      RSNLIB_SERIALIZE( voter_pending_stake, (voter)(stake) )
+   };
+
+   typedef arisen::multi_index< "pendstakes"_n, voter_pending_stake > pending_stakes_table;
+
+   /**
+    * Proxy whose producers have not received all changes of its proxied vote weight yet.
+    *
+    * @details Stake changes of the accounts voting through a proxy are added to the proxy's `weight` here
+    * while they stay below the thresholds of `vote_debounce_parameters`. Such a proxy is listed until the
+    * pending weight is cast, once it reaches a threshold, when the proxy's weight is recomputed by a vote, by
+    * `flushproxies` or before an election.
+    */
+   struct [[arisen::table, arisen::contract("arisen.system")]] pending_proxy {
+      name     proxy;
+      int128_t weight = 0; ///< part of the proxy's `proxied_vote_weight` not cast yet
+
+      uint64_t primary_key()const { return proxy.value; }
+
+      RSNLIB_SERIALIZE( pending_proxy, (proxy)(weight) )
+   };
+
+   typedef arisen::multi_index< "pendproxies"_n, pending_proxy > pending_proxies_table;
+
+   /**
+    * Producer list shared by every voter voting for exactly these producers.
+    *
+    * @details Voters, and proxies voting for producers, reference the set with their `vote_set_id` instead of
+    * storing the list. The set sums the weights of its voters, and the producers' totals include its
+    * `cast_weight`. Votes move the voter's weight between the producers right away, while a stake change of a
+    * voter only updates `weight`; the difference is cast once it reaches the thresholds of
+    * `vote_debounce_parameters`, when a voter leaves the set, before an election or a claim, or by
+    * `flushvotesets`. Sets are removed once their last voter leaves. The voter that creates a set pays for it;
+    * once the `payer` leaves, the next voter of the set that votes or changes its stake takes the row over.
+    */
+   struct [[arisen::table("votesets"), arisen::contract("arisen.system")]] vote_set {
+      uint64_t          id;
+      checksum256       digest;           ///< sha256 of the packed producer list
+      std::vector<name> producers;        ///< the producers voted for, sorted
+      int128_t          weight = 0;       ///< summed vote weight of the voters
+      int128_t          cast_weight = 0;  ///< weight included in the producers' totals
+      uint32_t          voters = 0;
+      bool              pending = false;  ///< listed in the `pendvotesets` table
+      name              payer;            ///< voter paying for the row, empty once it left the set
+
+      uint64_t    primary_key()const { return id;     }
+      checksum256 by_digest()const   { return digest; }
+
+      RSNLIB_SERIALIZE( vote_set, (id)(digest)(producers)(weight)(cast_weight)(voters)(pending)(payer) )
+   };
+
+   typedef arisen::multi_index< "votesets"_n, vote_set,
+                               indexed_by<"bydigest"_n, const_mem_fun<vote_set, checksum256, &vote_set::by_digest>  >
+                             > vote_sets_table;
+
+   /**
+    * Vote set whose weight has not been cast in full, see `vote_set`.
+    */
+   struct [[arisen::table, arisen::contract("arisen.system")]] pending_vote_set {
+      uint64_t set_id;
+
+      uint64_t primary_key()const { return set_id; }
+
+      RSNLIB_SERIALIZE( pending_vote_set, (set_id) )
+   };
+
+   typedef arisen::multi_index< "pendvotesets"_n, pending_vote_set > pending_vote_sets_table;
+
 
    /**
     * Defines producer info table added in version 1.0
@@ -295,6 +841,12 @@ namespace arisensystem {
     */
    typedef arisen::multi_index< "producers2"_n, producer_info2 > producers_table2;
 
+   /**
+    * Defines the producer tables replacing `producers` and `producers2`
+    */
+   typedef arisen::multi_index< "prodstats"_n, producer_stats > producer_stats_table;
+   typedef arisen::multi_index< "prodconfig"_n, producer_config > producer_config_table;
+
    /**
     * Global state singleton added in version 1.0
     */
@@ -307,6 +859,18 @@ namespace arisensystem {
     * Global state singleton added in version 1.3
     */
    typedef arisen::singleton< "global3"_n, arisen_global_state3 > global_state3_singleton;
+   /**
+    * Consolidated global state singleton, replaces the three above
+    */
+   typedef arisen::singleton< "globalstate"_n, arisen_global_record > global_record_singleton;
+   /**
+    * Unpaid blocks of the current round, see `unpaid_blocks_buffer`
+    */
+   typedef arisen::singleton< "unpaidblocks"_n, unpaid_blocks_buffer > unpaid_blocks_singleton;
+   /**
+    * Candidates of the producer election, see `producer_ranking`
+    */
+   typedef arisen::singleton< "prodranking"_n, producer_ranking > producer_ranking_singleton;
 
    struct [[arisen::table, arisen::contract("arisen.system")]] user_resources {
       name          owner;
@@ -515,6 +1079,29 @@ namespace arisensystem {
    typedef arisen::multi_index< "comqueue"_n, com_order,
                                indexed_by<"bytime"_n, const_mem_fun<com_order, uint64_t, &com_order::by_time>>> com_order_table;
 
+   /**
+    * One vote of a `bulkvote` action, with the same meaning as the arguments of `voteproducer`.
+    */
+   struct producer_vote {
+      name              voter;
+      name              proxy;
+      std::vector<name> producers;
+
+      RSNLIB_SERIALIZE( producer_vote, (voter)(proxy)(producers) )
+   };
+
+   /**
+    * One purchase of a `buyrambatch` action, either a number of `bytes` as with `buyrambytes` or the
+    * quantity of tokens `quant` as with `buyram`.
+    */
+   struct ram_purchase {
+      name     receiver;
+      int64_t  bytes = 0;
+      asset    quant;
+
+      RSNLIB_SERIALIZE( ram_purchase, (receiver)(bytes)(quant) )
+   };
+
    struct com_order_outcome {
       bool success;
       asset proceeds;
@@ -529,15 +1116,39 @@ namespace arisensystem {
    class [[arisen::contract("arisen.system")]] system_contract : public native {
 
       private:
-         voters_table            _voters;
+         voters_table            _legacy_voters;
+         voters_table2           _voters;
+         pending_proxies_table   _pending_proxies;
+         pending_stakes_table    _pending_stakes;
+         vote_sets_table         _vote_sets;
+         pending_vote_sets_table _pending_vote_sets;
          producers_table         _producers;
          producers_table2        _producers2;
+         producer_stats_table    _producer_stats;
+         producer_config_table   _producer_config;
          global_state_singleton  _global;
          global_state2_singleton _global2;
          global_state3_singleton _global3;
-         arisen_global_state      _gstate;
-         arisen_global_state2     _gstate2;
-         arisen_global_state3     _gstate3;
+         global_record_singleton _global_record;
+         unpaid_blocks_singleton _unpaid_blocks;
+         producer_ranking_singleton _producer_ranking;
+         std::optional<bool>                 _legacy_gstate; ///< global state still lives in the pre-`mergeglobals` singletons
+         std::optional<arisen_global_state>  _gstate;  ///< loaded on first use, see gstate()
+         std::optional<arisen_global_state2> _gstate2; ///< loaded on first use, see gstate2()
+         std::optional<arisen_global_state3> _gstate3; ///< loaded on first use, see gstate3()
+         bool                    _gstate_dirty  = false; ///< set whenever _gstate is modified, written back on destruction
+         bool                    _gstate2_dirty = false; ///< set whenever _gstate2 is modified, written back on destruction
+         bool                    _gstate3_dirty = false; ///< set whenever _gstate3 is modified, written back on destruction
+         std::optional<fixed_vote_totals>    _vote_totals; ///< loaded with the record or derived on first use, see vote_totals()
+         std::optional<election_state>       _election;    ///< loaded with the record, not stored with the legacy singletons
+         std::optional<schedule_parameters>  _schedule;    ///< loaded with the record, not stored with the legacy singletons
+         std::optional<vote_debounce_parameters> _vote_debounce; ///< loaded with the record, not stored with the legacy singletons
+         std::optional<name_auction_state>       _name_auction;  ///< loaded with the record, not stored with the legacy singletons
+         std::optional<payout_state>             _payout;        ///< loaded with the record, not stored with the legacy singletons
+         std::map<name, std::pair<const producer_stats*, int128_t>> _vote_deltas; ///< producer vote changes not written yet, see apply_vote_deltas()
+         bool                    _defer_vote_deltas = false; ///< set while a `bulkvote` collects the changes of all its votes
+         std::optional<producer_ranking>     _ranking;       ///< loaded on first use, see ranking()
+         bool                    _ranking_dirty = false;     ///< set whenever _ranking is modified, written back on destruction
          rammarket               _rammarket;
          com_pool_table          _compool;
          com_fund_table          _comfunds;
@@ -555,6 +1166,9 @@ namespace arisensystem {
          static constexpr arisen::name names_account{"arisen.names"_n};
          static constexpr arisen::name saving_account{"arisen.save"_n};
          static constexpr arisen::name com_account{"arisen.com"_n};
+
+         /// global state the dispatched action declared in `action_state_manifest()`, installed by the contract entry point
+         static inline uint32_t declared_state = ~uint32_t(0);
          static constexpr arisen::name null_account{"arisen.null"_n};
          static constexpr symbol ramcore_symbol = symbol(symbol_code("RAMCORE"), 4);
          static constexpr symbol ram_symbol     = symbol(symbol_code("RAM"), 0);
@@ -1027,6 +1641,24 @@ namespace arisensystem {
          [[arisen::action]]
          void buyrambytes( const name& payer, const name& receiver, uint32_t bytes );
 
+         /**
+          * Buy ram for many receivers action.
+          *
+          * @details Buys ram for every receiver of `purchases` in a single trade. The purchases in bytes are priced
+          * together like one `buyrambytes` of their sum, the tokens of all purchases are converted at once, with one
+          * transfer and one fee, and each purchase in bytes gets the bytes it asks for. The purchases of a quantity
+          * share the remaining ram in proportion to their tokens.
+          *
+          * @param payer - the ram buyer,
+          * @param purchases - the receivers and the bytes or the quantity of tokens bought for each of them.
+          *
+          * @pre At least one purchase,
+          * @pre Every purchase gives either a positive number of bytes or a positive quantity of core tokens,
+          * @pre Every receiver gets a positive amount of ram.
+          */
+         [[arisen::action]]
+         void buyrambatch( const name& payer, const std::vector<ram_purchase>& purchases );
+
          /**
           * Sell ram action.
           *
@@ -1056,13 +1688,14 @@ namespace arisensystem {
           * Register producer action.
           *
           * @details Register producer action, indicates that a particular account wishes to become a producer,
-          * this action will create a `producer_config` and a `producer_info` object for `producer` scope
+          * this action will create a `producer_config` and a `producer_stats` object for `producer` scope
           * in producers tables.
           *
           * @param producer - account registering to be a producer candidate,
           * @param producer_key - the public key of the block producer, this is the key used by block producer to sign blocks,
           * @param url - the url of the block producer, normally the url of the block producer presentation website,
-          * @param location - is the country code as defined in the ISO 3166, https://en.wikipedia.org/wiki/List_of_ISO_3166_country_codes
+          * @param location - is the country code as defined in the ISO 3166, https://en.wikipedia.org/wiki/List_of_ISO_3166_country_codes,
+          * or the longitude encoding read by the location order of `setschedord`, see `producer_schedule.hpp`
           *
           * @pre Producer is not already registered
           * @pre Producer to register is an account
@@ -1129,6 +1762,21 @@ namespace arisensystem {
          [[arisen::action]]
          void voteproducer( const name& voter, const name& proxy, const std::vector<name>& producers );
 
+         /**
+          * Bulk vote action.
+          *
+          * @details Casts several votes in one action, each with the same effect as a `voteproducer` action
+          * by its voter. Producers are updated once for the whole batch with the sum of the vote changes, which
+          * leaves the same state as the individual `voteproducer` actions executed in the same order.
+          *
+          * @param votes - the votes to cast, in order.
+          *
+          * @pre Every vote satisfies the preconditions of `voteproducer`
+          * @pre The voter of every vote must authorize this action
+          */
+         [[arisen::action]]
+         void bulkvote( const std::vector<producer_vote>& votes );
+
          /**
           * Register proxy action.
           *
@@ -1161,12 +1809,63 @@ namespace arisensystem {
          /**
           * Claim rewards action.
           *
-          * @details Claim block producing and vote rewards.
+          * @details Claim block producing and vote rewards. Pay credited by `settlepay` is withdrawn as well, it can be
+          * withdrawn at any time.
           * @param owner - producer account claiming per-block and per-vote rewards.
           */
          [[arisen::action]]
          void claimrewards( const name& owner );
 
+         /**
+          * Settle pay action.
+          *
+          * @details Settles the producer pay of the day. The first call of a day issues the inflation since the
+          * last fill and funds the savings and pay buckets once; then it and the following calls credit the block
+          * and vote pay of up to `max` producers each, in name order, as if they had claimed it. Credits are
+          * withdrawn with `claimrewards`. Claims do not issue tokens while the buckets were funded by a
+          * settlement within the past day. A credit is not a claim: producers that have not claimed within
+          * `producer_pay::votepay_threshold` are skipped, and stop earning vote pay until they claim.
+          *
+          * @param user - the account paying for the action,
+          * @param max - maximum number of producers visited.
+          *
+          * @pre Global state and producers must have been migrated,
+          * @pre The chain must be activated,
+          * @pre No settlement completed within the past day.
+          */
+         [[arisen::action]]
+         void settlepay( const name& user, uint16_t max );
+
+         /**
+          * Claim rewards to stake action.
+          *
+          * @details Claims block producing and vote rewards like `claimrewards` and stakes them for `receiver`, half for
+          * NET and half for CPU bandwidth, as `delegatebw` would. The rewards go from the pay accounts to `arisen.stake`
+          * directly and the votes of the staking account are refreshed once.
+          *
+          * @param owner - producer account claiming per-block and per-vote rewards,
+          * @param receiver - the account the rewards are staked to,
+          * @param transfer - if true, ownership of the staked tokens is transferred to `receiver`.
+          *
+          * @pre The same as for `claimrewards`,
+          * @pre Transfer flag cannot be used when staking to self.
+          */
+         [[arisen::action]]
+         void claimtostake( const name& owner, const name& receiver, bool transfer );
+
+         /**
+          * Claim rewards to COM fund action.
+          *
+          * @details Claims block producing and vote rewards like `claimrewards` and deposits them into the COM fund of
+          * `owner`. The rewards go from the pay accounts to `arisen.com` directly.
+          *
+          * @param owner - producer account claiming per-block and per-vote rewards.
+          *
+          * @pre The same as for `claimrewards`.
+          */
+         [[arisen::action]]
+         void claimtocom( const name& owner );
+
          /**
           * Set privilege status for an account.
           *
@@ -1198,6 +1897,110 @@ namespace arisensystem {
          [[arisen::action]]
          void updtrevision( uint8_t revision );
 
+         /**
+          * Merge globals action.
+          *
+          * @details Moves the global state from the `global`, `global2` and `global3` singletons into the
+          * consolidated `globalstate` record and removes the legacy singletons. Until this runs, the contract
+          * keeps reading and writing the legacy singletons.
+          *
+          * @pre The global state has not been merged yet.
+          */
+         [[arisen::action]]
+         void mergeglobals();
+
+         /**
+          * Migrate producers action.
+          *
+          * @details Moves up to `max_rows` producers from the `producers` and `producers2` tables into the
+          * `prodstats` and `prodconfig` tables and erases the old rows. Producers that have not been moved
+          * are moved the next time an action uses them, so the migration can be spread over several calls.
+          *
+          * @param max_rows - the maximum number of producers to move.
+          *
+          * @pre There are producers left in the `producers` table.
+          */
+         [[arisen::action]]
+         void migrateprods( uint32_t max_rows );
+
+         /**
+          * Migrate votes action.
+          *
+          * @details Moves up to `max_rows` voters from the `voters` table into the `voters2` table, and
+          * the producer lists stored in their rows into vote sets, see `voter_info2` and `vote_set`.
+          * Voters are otherwise moved when an action next uses them.
+          *
+          * @param max_rows - the maximum number of voters to move.
+          *
+          * @pre There are voters left in the `voters` table.
+          */
+         [[arisen::action]]
+         void migratevotes( uint32_t max_rows );
+
+         /**
+          * Set schedule order action.
+          *
+          * @details Selects the order in which the elected producers are arranged in the proposed
+          * producer schedules, see `producer_schedule.hpp`. The next election proposes the elected
+          * producers in the new order.
+          *
+          * @param order - 0 to order the producers by name, 1 to arrange them in a cyclic tour over
+          * their locations.
+          *
+          * The location order reads `location` as the longitude scaled to 16 bits. Producers register country
+          * codes today, which give an arbitrary tour, so it must only be selected once the elected producers
+          * have registered longitude-encoded locations.
+          *
+          * @pre The global state has been merged by `mergeglobals`.
+          */
+         [[arisen::action]]
+         void setschedord( uint8_t order );
+
+         /**
+          * Set vote delta action.
+          *
+          * @details Sets the thresholds below which stake changes of a voter are accumulated instead of
+          * being cast with the voter's votes right away, see `vote_debounce_parameters`. A threshold of
+          * 0 is disabled; with both disabled every stake change is cast right away.
+          *
+          * @param min_stake_delta - the smallest stake change cast right away, in core token units,
+          * @param min_stake_delta_bp - the smallest stake change cast right away, in basis points of
+          * the stake the voter's votes were cast with.
+          *
+          * @pre The global state has been merged by `mergeglobals`.
+          * @pre `min_stake_delta` is not negative and `min_stake_delta_bp` is at most 10000.
+          */
+         [[arisen::action]]
+         void setvotedelta( int64_t min_stake_delta, uint16_t min_stake_delta_bp );
+
+         /**
+          * Flush proxies action.
+          *
+          * @details Casts the pending proxied vote weight of up to `max` proxies listed in the `pendproxies`
+          * table, see `pending_proxy`. The producers voted for by these proxies are updated in one pass.
+          *
+          * @param user - the account executing the action,
+          * @param max - the maximum number of proxies to flush.
+          *
+          * @pre There are proxies with pending vote weight.
+          */
+         [[arisen::action]]
+         void flushproxies( const name& user, uint16_t max );
+
+         /**
+          * Flush vote sets action.
+          *
+          * @details Casts the pending weight of up to `max` vote sets listed in the `pendvotesets` table,
+          * see `vote_set`. The producers of these sets are updated in one pass.
+          *
+          * @param user - the account executing the action,
+          * @param max - the maximum number of vote sets to flush.
+          *
+          * @pre There are vote sets with pending weight.
+          */
+         [[arisen::action]]
+         void flushvotesets( const name& user, uint16_t max );
+
          /**
           * Bid name action.
           *
@@ -1258,6 +2061,7 @@ namespace arisensystem {
          using undelegatebw_action = arisen::action_wrapper<"undelegatebw"_n, &system_contract::undelegatebw>;
          using buyram_action = arisen::action_wrapper<"buyram"_n, &system_contract::buyram>;
          using buyrambytes_action = arisen::action_wrapper<"buyrambytes"_n, &system_contract::buyrambytes>;
+         using buyrambatch_action = arisen::action_wrapper<"buyrambatch"_n, &system_contract::buyrambatch>;
          using sellram_action = arisen::action_wrapper<"sellram"_n, &system_contract::sellram>;
          using refund_action = arisen::action_wrapper<"refund"_n, &system_contract::refund>;
          using regproducer_action = arisen::action_wrapper<"regproducer"_n, &system_contract::regproducer>;
@@ -1265,10 +2069,21 @@ namespace arisensystem {
          using setram_action = arisen::action_wrapper<"setram"_n, &system_contract::setram>;
          using setramrate_action = arisen::action_wrapper<"setramrate"_n, &system_contract::setramrate>;
          using voteproducer_action = arisen::action_wrapper<"voteproducer"_n, &system_contract::voteproducer>;
+         using bulkvote_action = arisen::action_wrapper<"bulkvote"_n, &system_contract::bulkvote>;
          using regproxy_action = arisen::action_wrapper<"regproxy"_n, &system_contract::regproxy>;
          using claimrewards_action = arisen::action_wrapper<"claimrewards"_n, &system_contract::claimrewards>;
+         using settlepay_action = arisen::action_wrapper<"settlepay"_n, &system_contract::settlepay>;
+         using claimtostake_action = arisen::action_wrapper<"claimtostake"_n, &system_contract::claimtostake>;
+         using claimtocom_action = arisen::action_wrapper<"claimtocom"_n, &system_contract::claimtocom>;
          using rmvproducer_action = arisen::action_wrapper<"rmvproducer"_n, &system_contract::rmvproducer>;
          using updtrevision_action = arisen::action_wrapper<"updtrevision"_n, &system_contract::updtrevision>;
+         using mergeglobals_action = arisen::action_wrapper<"mergeglobals"_n, &system_contract::mergeglobals>;
+         using migrateprods_action = arisen::action_wrapper<"migrateprods"_n, &system_contract::migrateprods>;
+         using migratevotes_action = arisen::action_wrapper<"migratevotes"_n, &system_contract::migratevotes>;
+         using setschedord_action = arisen::action_wrapper<"setschedord"_n, &system_contract::setschedord>;
+         using setvotedelta_action = arisen::action_wrapper<"setvotedelta"_n, &system_contract::setvotedelta>;
+         using flushproxies_action = arisen::action_wrapper<"flushproxies"_n, &system_contract::flushproxies>;
+         using flushvotesets_action = arisen::action_wrapper<"flushvotesets"_n, &system_contract::flushvotesets>;
          using bidname_action = arisen::action_wrapper<"bidname"_n, &system_contract::bidname>;
          using bidrefund_action = arisen::action_wrapper<"bidrefund"_n, &system_contract::bidrefund>;
          using setpriv_action = arisen::action_wrapper<"setpriv"_n, &system_contract::setpriv>;
@@ -1286,6 +2101,23 @@ namespace arisensystem {
 
          //defined in arisen.system.cpp
          static arisen_global_state get_default_parameters();
+         bool legacy_gstate();
+         const arisen_global_state&  gstate();
+         const arisen_global_state2& gstate2();
+         const arisen_global_state3& gstate3();
+         arisen_global_state&        mutable_gstate();
+         arisen_global_state2&       mutable_gstate2();
+         arisen_global_state3&       mutable_gstate3();
+         const fixed_vote_totals&    vote_totals();
+         const election_state&       election();
+         election_state&             mutable_election();
+         const schedule_parameters&  schedule_params();
+         const vote_debounce_parameters& vote_debounce();
+         vote_debounce_parameters&       mutable_vote_debounce();
+         const name_auction_state&       name_auction();
+         name_auction_state&             mutable_name_auction();
+         const payout_state&             payout();
+         payout_state&                   mutable_payout();
          symbol core_symbol()const;
          void update_ram_supply();
 
@@ -1293,7 +2125,7 @@ namespace arisensystem {
          void runcom( uint16_t max );
          void update_resource_limits( const name& from, const name& receiver, int64_t delta_net, int64_t delta_cpu );
          void check_voting_requirement( const name& owner,
-                                        const char* error_msg = "must vote for at least 21 producers or for a proxy before buying COM" )const;
+                                        const char* error_msg = "must vote for at least 21 producers or for a proxy before buying COM" );
          com_order_outcome fill_com_order( const com_balance_table::const_iterator& bitr, const asset& com );
          asset update_com_account( const name& owner, const asset& proceeds, const asset& unstake_quant, bool force_vote_update = false );
          void channel_to_com( const name& from, const asset& amount );
@@ -1324,20 +2156,60 @@ namespace arisensystem {
          template <typename Index, typename Iterator>
          int64_t update_renewed_loan( Index& idx, const Iterator& itr, int64_t rented_tokens );
 
+         // defined in producer_pay.cpp
+         bool flush_unpaid_blocks( unpaid_blocks_buffer& buffer );
+         void fill_pay_buckets( const time_point& ct );
+         std::pair<int64_t, int64_t> credit_producer_pay( const producer_stats& prod, const time_point& ct, bool claim );
+         std::pair<int64_t, int64_t> take_producer_pay( const name& owner );
+         void send_producer_pay( const name& owner, const name& to, int64_t block_pay, int64_t vote_pay, const std::string& memo );
+         void refresh_name_auction();
+
          // defined in delegate_bandwidth.cpp
          void changebw( name from, const name& receiver,
-                        const asset& stake_net_quantity, const asset& stake_cpu_quantity, bool transfer );
+                        const asset& stake_net_quantity, const asset& stake_cpu_quantity, bool transfer, bool funded = false );
          void update_voting_power( const name& voter, const asset& total_update );
+         bool defer_stake_change( int64_t pending, int64_t voted_stake );
+         void add_ram( const name& receiver, int64_t bytes );
 
          // defined in voting.hpp
          void update_elected_producers( const block_timestamp& timestamp );
+         void note_producer_change( int128_t votes );
+         const producer_ranking& ranking();
+         producer_ranking& mutable_ranking();
+         void update_producer_ranking( const producer_stats& prod );
+         void rebuild_producer_ranking();
+         std::vector<ranked_producer> ranked_candidates();
+         producer_stats_table::const_iterator find_producer( const name& producer );
+         producer_stats_table::const_iterator migrate_producer( const producers_table::const_iterator& legacy );
+         void deactivate_producer( const producer_stats_table::const_iterator& prod );
          void update_votes( const name& voter, const name& proxy, const std::vector<name>& producers, bool voting );
-         void propagate_weight_change( const voter_info& voter );
-         double update_producer_votepay_share( const producers_table2::const_iterator& prod_itr,
-                                               const time_point& ct,
-                                               double shares_rate, bool reset_to_zero = false );
-         double update_total_votepay_share( const time_point& ct,
-                                            double additional_shares_delta = 0.0, double shares_rate_delta = 0.0 );
+         void propagate_weight_change( const voter_info2& voter );
+         void update_proxied_weight( const voter_info2& proxy, int128_t delta, bool defer, const name& payer = name() );
+         bool defer_weight_change( int128_t pending, int128_t cast_weight );
+         void flush_pending_proxies( uint32_t max );
+         int64_t pending_stake_of( const voter_info2& voter )const;
+         int128_t pending_proxied_of( const voter_info2& proxy )const;
+         void clear_pending_changes( const voter_info2& voter );
+         const std::vector<name>& voted_producers( const voter_info2& voter )const;
+         const vote_set& intern_vote_set( const std::vector<name>& producers, const name& payer );
+         voters_table2::const_iterator find_voter( const name& voter );
+         const voter_info2& get_voter( const name& voter, const char* error_msg );
+         voters_table2::const_iterator migrate_voter( const voters_table::const_iterator& legacy );
+         void settle_vote_set( const vote_set& set, bool flush, const name& payer = name() );
+         void flush_pending_vote_sets( uint32_t max );
+         void cast_vote( const name& voter, const name& proxy, const std::vector<name>& producers );
+         void apply_vote_deltas( const std::vector<name>& old_producers, int128_t old_weight,
+                                 const std::vector<name>& new_producers, int128_t new_weight, bool voting );
+         void flush_vote_deltas();
+         void update_total_vote_weight( int128_t delta );
+         std::optional<producer_votepay> legacy_votepay( const producer_info& prod );
+         int128_t update_producer_votepay_share( producer_votepay& votepay,
+                                                 const time_point& ct,
+                                                 int128_t shares_rate, bool reset_to_zero = false );
+         int128_t update_total_votepay_share( const time_point& ct,
+                                              int128_t additional_shares_delta = 0, int128_t shares_rate_delta = 0 );
+         producer_pay::votepay_totals load_votepay_totals();
+         void store_votepay_totals( const producer_pay::votepay_totals& totals );
 
          template <auto system_contract::*...Ptrs>
          class registration {
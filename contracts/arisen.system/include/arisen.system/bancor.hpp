@@ -0,0 +1,191 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+#ifdef BANCOR_COMPAT_ROUNDING
+#undef BANCOR_COMPAT_ROUNDING
+#endif
+// BANCOR_COMPAT_ROUNDING macro determines whether the RAM market and the COM pool reproduce, bit for bit,
+// the rounding of the former double precision connector math instead of flooring the exact quotient. The
+// compatible rounding costs several times the exact one natively (see native/bancor_benchmark.cpp) and has
+// not been measured inside the VM yet, so it is opt-in: in order to enable it, the macro must be set to 1.
+#define BANCOR_COMPAT_ROUNDING 0
+
+/**
+ * Integer implementation of the Bancor connector math used by `exchange_state` and the COM pool.
+ *
+ * @details This header only depends on the standard library so that it can be shared with native
+ * tools and tests. Arguments may be negative, e.g. a COM pool whose `total_unlent` dropped to or below 0,
+ * and results that come out negative are clamped to 0 like the former implementation did. Where the former
+ * implementation trapped, on a division by zero or a result beyond `int64_t`, `overflow` is returned and
+ * `exchange_state` rejects it.
+ */
+namespace arisensystem { namespace bancor {
+
+   using int128  = __int128;
+   using uint128 = unsigned __int128;
+
+   /// returned instead of a result that does not fit into `int64_t` or has a zero denominator; no valid
+   /// amount reaches it, token supplies are capped at 2^62 - 1
+   static constexpr int64_t overflow = std::numeric_limits<int64_t>::max();
+
+   namespace detail {
+
+      /// number of significant bits of `v`
+      inline int bit_width( uint128 v ) {
+         const uint64_t hi = uint64_t(v >> 64);
+         const uint64_t lo = uint64_t(v);
+         if( hi ) return 128 - __builtin_clzll(hi);
+         if( lo ) return 64 - __builtin_clzll(lo);
+         return 0;
+      }
+
+      /// rounds `v` to 53 significant bits, ties to even, which is what storing it in a double does
+      inline uint128 round53( uint128 v ) {
+         const int bits = bit_width(v);
+         if( bits <= 53 ) return v;
+         const int     drop = bits - 53;
+         const uint128 half = uint128(1) << (drop - 1);
+         const uint128 rem  = v & ((uint128(1) << drop) - 1);
+         v >>= drop;
+         if( rem > half || (rem == half && (v & 1)) ) ++v;
+         return v << drop;
+      }
+
+      /**
+       * Truncated result of dividing two doubles holding `n` and `d`, i.e. `trunc(round53(n / d))`.
+       *
+       * @pre `d > 0` and `d < 2^73` so that the remainder can be scaled by the fraction bits without overflow
+       */
+      inline uint128 div_round53_trunc( uint128 n, uint128 d ) {
+         const uint128 q    = n / d;
+         const uint128 r    = n % d;
+         const int     bits = bit_width(q);
+
+         if( bits == 0 ) {
+            // below one the only way to reach an integer is rounding up to exactly 1.0,
+            // which happens when n / d >= 1 - 2^-54 (the tie rounds to the even 1.0)
+            return ( (d - r) << 54 ) <= d ? 1 : 0;
+         }
+
+         if( bits >= 53 ) {
+            // the fraction is entirely below the last kept bit and only acts as the sticky bit
+            const int drop = bits - 53;
+            uint128 m;
+            bool round_up;
+            if( drop == 0 ) {
+               m        = q;
+               round_up = r > d - r || (r == d - r && (m & 1));
+            } else {
+               const uint128 half = uint128(1) << (drop - 1);
+               const uint128 rem  = q & ((uint128(1) << drop) - 1);
+               m        = q >> drop;
+               round_up = rem > half || (rem == half && (r != 0 || (m & 1)));
+            }
+            if( round_up ) ++m;
+            return m << drop;
+         }
+
+         // the mantissa takes 53 - bits fraction bits, plus one more for rounding
+         const int     frac_bits = 53 - bits;
+         const uint128 scaled    = r << (frac_bits + 1);
+         const uint128 f         = scaled / d;
+         const bool    sticky    = (scaled % d) != 0;
+         uint128 m = (q << frac_bits) | (f >> 1);
+         if( (f & 1) && (sticky || (m & 1)) ) ++m;
+         return m >> frac_bits;
+      }
+
+      inline int64_t to_int64( uint128 v ) {
+         return v >= uint128(overflow) ? overflow : int64_t(v);
+      }
+
+      inline uint128 magnitude( int128 v ) {
+         return v < 0 ? uint128(-v) : uint128(v);
+      }
+
+      /// `round53` of a signed value, which rounds its magnitude like a double does
+      inline int128 sround53( int128 v ) {
+         return v < 0 ? -int128( round53( uint128(-v) ) ) : int128( round53( uint128(v) ) );
+      }
+
+      /// whether `num / den` is below zero, in which case a result within range is clamped to 0
+      inline bool negative_quotient( int128 num, int128 den ) {
+         return num != 0 && (num < 0) != (den < 0);
+      }
+
+   } /// namespace detail
+
+   /**
+    * Exact integer connector math: every result is the floor of the exact rational value.
+    */
+   namespace exact {
+
+      /**
+       * Output amount for `inp` tokens sold into a connector pair, `inp * out_reserve / (inp_reserve + inp)`.
+       */
+      inline int64_t get_bancor_output( int64_t inp_reserve, int64_t out_reserve, int64_t inp ) {
+         const int128 num = int128(inp) * out_reserve;
+         const int128 den = int128(inp_reserve) + inp;
+         if( den == 0 ) return overflow;
+         const int64_t q = detail::to_int64( detail::magnitude(num) / detail::magnitude(den) );
+         return detail::negative_quotient( num, den ) && q != overflow ? 0 : q;
+      }
+
+      /**
+       * Input amount needed to buy `out` tokens from a connector pair, `inp_reserve * out / (out_reserve - out)`.
+       */
+      inline int64_t get_bancor_input( int64_t out_reserve, int64_t inp_reserve, int64_t out ) {
+         const int128 num = int128(inp_reserve) * out;
+         const int128 den = int128(out_reserve) - out;
+         if( den == 0 ) return overflow;
+         const int64_t q = detail::to_int64( detail::magnitude(num) / detail::magnitude(den) );
+         return detail::negative_quotient( num, den ) && q != overflow ? 0 : q;
+      }
+
+   } /// namespace exact
+
+   /**
+    * Integer connector math that reproduces the former double precision implementation: every operand
+    * and intermediate result is rounded to 53 significant bits exactly like the IEEE 754 operations did.
+    */
+   namespace compat {
+
+      /**
+       * Same result as `int64_t( (double(inp) * double(out_reserve)) / (double(inp_reserve) + double(inp)) )`.
+       */
+      inline int64_t get_bancor_output( int64_t inp_reserve, int64_t out_reserve, int64_t inp ) {
+         using detail::sround53;
+         const int128 in  = sround53( inp );
+         const int128 num = sround53( in * sround53( out_reserve ) );
+         const int128 den = sround53( sround53( inp_reserve ) + in );
+         if( den == 0 ) return overflow;
+         const int64_t q = detail::to_int64( detail::div_round53_trunc( detail::magnitude(num), detail::magnitude(den) ) );
+         return detail::negative_quotient( num, den ) && q != overflow ? 0 : q;
+      }
+
+      /**
+       * Same result as `int64_t( (double(inp_reserve) * out) / (double(out_reserve) - out) )`.
+       */
+      inline int64_t get_bancor_input( int64_t out_reserve, int64_t inp_reserve, int64_t out ) {
+         using detail::sround53;
+         const int128 o   = sround53( out );
+         const int128 num = sround53( sround53( inp_reserve ) * o );
+         const int128 den = sround53( sround53( out_reserve ) - o );
+         if( den == 0 ) return overflow;
+         const int64_t q = detail::to_int64( detail::div_round53_trunc( detail::magnitude(num), detail::magnitude(den) ) );
+         return detail::negative_quotient( num, den ) && q != overflow ? 0 : q;
+      }
+
+   } /// namespace compat
+
+#if BANCOR_COMPAT_ROUNDING
+   using compat::get_bancor_output;
+   using compat::get_bancor_input;
+#else
+   using exact::get_bancor_output;
+   using exact::get_bancor_input;
+#endif
+
+} } /// namespace arisensystem::bancor
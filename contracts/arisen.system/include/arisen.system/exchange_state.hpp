@@ -34,13 +34,11 @@ namespace arisensystem {
 
       uint64_t primary_key()const { return supply.symbol.raw(); }
 
-      asset convert_to_exchange( connector& reserve, const asset& payment );
-      asset convert_from_exchange( connector& reserve, const asset& tokens );
-      asset convert( const asset& from, const symbol& to );
       asset direct_convert( const asset& from, const symbol& to );
       /**
        * Given two connector balances (inp_reserve and out_reserve), and an incoming amount
        * of inp, this function calculates the delta out using Banacor equation.
+       * Integer math is used, see arisen.system/bancor.hpp.
        *
        * @param inp - input amount, same units as inp_reserve
        * @param inp_reserve - the input connector balance
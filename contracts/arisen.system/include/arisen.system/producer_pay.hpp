@@ -0,0 +1,198 @@
+#pragma once
+
+#include <arisen.system/vote_weight.hpp>
+
+#include <algorithm>
+#include <cstdint>
+
+/**
+ * Inflation and producer pay arithmetic of `claimrewards` and `settlepay`.
+ *
+ * @details The contract loads the pay buckets, the votepay totals and the producer row into the plain structures
+ * below, runs `claim` and stores them back, so that the same code computes the pay on chain and in native models
+ * of the producer economics. Times are microseconds since the epoch, `0` standing for a time that was never set.
+ *
+ * This header only depends on the standard library so that it can be shared with native tools and tests.
+ */
+namespace arisensystem { namespace producer_pay {
+
+   using int128 = vote_weight::int128;
+
+   static constexpr int64_t votepay_threshold = int64_t(3 * 24 * 3600) * 1000'000; // vote pay is only paid on claims within this period
+
+   /**
+    * Economic parameters, the contract uses the constants of `arisen.system.hpp`.
+    */
+   struct parameters {
+      double  continuous_rate;        ///< annual inflation rate
+      int64_t inflation_pay_factor;   ///< the producers get `1 / inflation_pay_factor` of the inflation
+      int64_t votepay_factor;         ///< of which `1 / votepay_factor` is block pay
+      int64_t min_pervote_daily_pay;  ///< smaller vote pay is not paid
+      int64_t useconds_per_year;
+   };
+
+   /**
+    * Tokens issued for an interval and their split between the savings and the pay buckets.
+    */
+   struct issuance {
+      int64_t total            = 0;
+      int64_t to_savings       = 0;
+      int64_t to_per_block_pay = 0;
+      int64_t to_per_vote_pay  = 0;
+   };
+
+   /**
+    * Pay buckets, funded by the inflation and emptied by the claims.
+    */
+   struct buckets {
+      int64_t  perblock_bucket     = 0;
+      int64_t  pervote_bucket      = 0;
+      uint32_t total_unpaid_blocks = 0;
+   };
+
+   /**
+    * Sum of the votepay shares of all producers, accruing at `change_rate` shares per votepay period.
+    */
+   struct votepay_totals {
+      int128  share       = 0;
+      int128  change_rate = 0;
+      int64_t last_update = 0;
+   };
+
+   /**
+    * Votepay share of one producer, `last_update` is `0` for producers without votepay accounting.
+    */
+   struct votepay_account {
+      int128  share       = 0;
+      int64_t last_update = 0;
+   };
+
+   /**
+    * The parts of a producer row a claim reads and updates.
+    */
+   struct producer {
+      int128          votes           = 0;
+      uint32_t        unpaid_blocks   = 0;
+      int64_t         last_claim_time = 0;
+      votepay_account votepay;
+   };
+
+   /**
+    * Block pay and vote pay of a claim.
+    */
+   struct pay {
+      int64_t per_block = 0;
+      int64_t per_vote  = 0;
+   };
+
+   /**
+    * Inflation of a `supply` during `elapsed_us` microseconds.
+    */
+   inline issuance inflation( const parameters& p, int64_t supply, int64_t elapsed_us ) {
+      issuance i;
+      i.total = static_cast<int64_t>( (p.continuous_rate * double(supply) * double(elapsed_us)) / double(p.useconds_per_year) );
+
+      const int64_t to_producers = i.total / p.inflation_pay_factor;
+      i.to_savings       = i.total - to_producers;
+      i.to_per_block_pay = to_producers / p.votepay_factor;
+      i.to_per_vote_pay  = to_producers - i.to_per_block_pay;
+      return i;
+   }
+
+   /**
+    * Accrues the total votepay share up to `now` and applies the given changes. Returns the new total.
+    */
+   inline int128 update_total_votepay_share( votepay_totals& totals, int64_t now, int128 additional_shares_delta = 0,
+                                             int128 shares_rate_delta = 0 ) {
+      int128 delta_total_votepay_share = 0;
+      if( now > totals.last_update ) {
+         delta_total_votepay_share = vote_weight::accrue( totals.change_rate, now - totals.last_update );
+      }
+
+      // the totals are exact sums of the producer shares and rates, they can only fall below zero
+      // by the rounding left behind in values converted from the former double precision fields
+      totals.share       = std::max<int128>( totals.share + delta_total_votepay_share + additional_shares_delta, 0 );
+      totals.change_rate = std::max<int128>( totals.change_rate + shares_rate_delta, 0 );
+      totals.last_update = now;
+      return totals.share;
+   }
+
+   /**
+    * Accrues the votepay share of a producer holding `shares_rate` votes up to `now`. Returns the accrued share,
+    * which the account keeps unless `reset_to_zero`.
+    */
+   inline int128 update_producer_votepay_share( votepay_account& votepay, int64_t now, int128 shares_rate,
+                                                bool reset_to_zero ) {
+      int128 delta_votepay_share = 0;
+      if( shares_rate > 0 && now > votepay.last_update ) {
+         delta_votepay_share = vote_weight::accrue( shares_rate, now - votepay.last_update );
+      }
+
+      const int128 new_votepay_share = votepay.share + delta_votepay_share;
+      votepay.share       = reset_to_zero ? 0 : new_votepay_share;
+      votepay.last_update = now;
+      return new_votepay_share;
+   }
+
+   /**
+    * Pays the unpaid blocks and the votepay share of `prod` out of the buckets at `now`, and resets them.
+    *
+    * @param share_based - whether the vote pay is split by votepay shares, otherwise by `total_vote_weight`
+    * @param total_vote_weight - summed votes of all producers, read for the vote pay before votepay shares existed
+    */
+   inline pay claim( const parameters& p, buckets& b, votepay_totals& totals, producer& prod, int64_t now,
+                     bool share_based, int128 total_vote_weight ) {
+      /// New metric to be used in pervote pay calculation. Instead of vote weight ratio, we combine vote weight and
+      /// time duration the vote weight has been held into one metric.
+      const int64_t last_claim_plus_3days = prod.last_claim_time + votepay_threshold;
+
+      const bool crossed_threshold       = (last_claim_plus_3days <= now);
+      bool       updated_after_threshold = true;
+      if( prod.votepay.last_update != 0 ) {
+         updated_after_threshold = (last_claim_plus_3days <= prod.votepay.last_update);
+      } else {
+         prod.votepay.last_update = now;
+      }
+
+      // Note: updated_after_threshold implies cross_threshold (except if claiming rewards when the producer had no votepay accounting yet).
+      // The exception leads to updated_after_threshold to be treated as true regardless of whether the threshold was crossed.
+      // This is okay because in this case the producer will not get paid anything either way.
+      // In fact it is desired behavior because the producers votes need to be counted in the global total_producer_votepay_share for the first time.
+
+      pay result;
+      if( b.total_unpaid_blocks > 0 ) {
+         result.per_block = (b.perblock_bucket * prod.unpaid_blocks) / b.total_unpaid_blocks;
+      }
+
+      const int128 new_votepay_share = update_producer_votepay_share( prod.votepay, now,
+                                                                      updated_after_threshold ? 0 : prod.votes,
+                                                                      true // reset votepay_share to zero after updating
+                                                                    );
+
+      if( share_based ) {
+         const int128 total_votepay_share = update_total_votepay_share( totals, now );
+         if( total_votepay_share > 0 && !crossed_threshold ) {
+            result.per_vote = vote_weight::pro_rata( b.pervote_bucket, new_votepay_share, total_votepay_share );
+            if( result.per_vote > b.pervote_bucket )
+               result.per_vote = b.pervote_bucket;
+         }
+      } else if( total_vote_weight > 0 ) {
+         result.per_vote = vote_weight::pro_rata( b.pervote_bucket, prod.votes, total_vote_weight );
+      }
+
+      if( result.per_vote < p.min_pervote_daily_pay ) {
+         result.per_vote = 0;
+      }
+
+      b.pervote_bucket      -= result.per_vote;
+      b.perblock_bucket     -= result.per_block;
+      b.total_unpaid_blocks -= prod.unpaid_blocks;
+
+      update_total_votepay_share( totals, now, -new_votepay_share, (updated_after_threshold ? prod.votes : 0) );
+
+      prod.last_claim_time = now;
+      prod.unpaid_blocks   = 0;
+      return result;
+   }
+
+} } /// namespace arisensystem::producer_pay
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+/**
+ * Ordering of the elected producers in a proposed schedule.
+ *
+ * @details Block production is handed from one producer to the next in schedule order, and from the last
+ * producer back to the first. Ordering by location makes the schedule a cyclic tour in which consecutive
+ * producers are close to each other, which shortens the network path each handoff depends on.
+ *
+ * The `location` of a producer is read as a position on a ring of `location_ring` codes, e.g. the
+ * longitude scaled to 16 bits, so that the codes just below `location_ring` are close to the codes just
+ * above 0. The distance of two codes is the length of the shorter arc between them. Visiting the points
+ * of a circle in the order of their positions gives the shortest cyclic tour over them, so the tour is
+ * a sort by location, with ties broken by the name order of the input.
+ *
+ * The encoding is `floor((longitude + 180) * 65536 / 360)` for a longitude in degrees east, wrapped to the
+ * ring. Producers have traditionally registered ISO 3166 country codes as their location, which this order
+ * reads as meaningless positions, so `by_location` only gives a geographic tour once the producers have
+ * registered again with longitude-encoded locations.
+ *
+ * This header only depends on the standard library so that it can be shared with native tools and tests.
+ */
+namespace arisensystem { namespace producer_schedule {
+
+   static constexpr uint32_t location_ring = 1u << 16; // number of location codes on the ring
+
+   /**
+    * Orderings of the elected producers, selected with `setschedord`.
+    */
+   enum order : uint8_t {
+      by_name     = 0, ///< alphabetical, the order producer schedules have always used
+      by_location = 1, ///< cyclic tour over the location codes
+      order_count
+   };
+
+   /**
+    * Distance of two location codes, the length of the shorter arc between them on the ring.
+    */
+   inline uint32_t handoff_distance( uint32_t a, uint32_t b ) {
+      const uint32_t d = ( a > b ? a - b : b - a ) % location_ring;
+      return d < location_ring - d ? d : location_ring - d;
+   }
+
+   /**
+    * Summed handoff distance of one round of the schedule `[first, last)`, including the handoff from the
+    * last producer back to the first one. `location_of` returns the location code of an element.
+    */
+   template<typename It, typename LocationOf>
+   uint64_t tour_length( It first, It last, LocationOf location_of ) {
+      if( first == last ) return 0;
+      uint64_t total = 0;
+      auto prev = first;
+      for( auto it = std::next(first); it != last; prev = it++ ) {
+         total += handoff_distance( location_of(*prev), location_of(*it) );
+      }
+      return total + handoff_distance( location_of(*prev), location_of(*first) );
+   }
+
+   /**
+    * Arranges the producers `[first, last)`, given in name order, in the order `o`.
+    */
+   template<typename It, typename LocationOf>
+   void arrange( It first, It last, order o, LocationOf location_of ) {
+      if( o == by_location ) {
+         std::stable_sort( first, last, [&]( const auto& a, const auto& b ) {
+            return location_of(a) % location_ring < location_of(b) % location_ring;
+         });
+      }
+   }
+
+} } /// namespace arisensystem::producer_schedule
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+/**
+ * Fixed-point vote weight arithmetic used by producer voting and the per-vote pay accounting.
+ *
+ * @details A vote weight is the staked amount scaled by `2 ^ (weeks_since_epoch / 52)` and is kept as a
+ * 128-bit integer in units of one staked token unit at the block timestamp epoch. Votepay shares are vote
+ * weights multiplied by the time they were held, counted in block intervals. Sums and differences of these
+ * values are exact, so producer totals return to exactly zero once every vote is withdrawn.
+ *
+ * The multiplier table covers 63 years after the block timestamp epoch; stake held by the whole supply,
+ * voting for 30 producers and accruing votepay shares for a full year stays within range until then.
+ * Later weeks keep the multiplier of the last covered week, so votes cast after that weigh the same as
+ * the votes of that week instead of failing.
+ *
+ * This header only depends on the standard library so that it can be shared with native tools and tests.
+ */
+namespace arisensystem { namespace vote_weight {
+
+   using int128  = __int128;
+   using uint128 = unsigned __int128;
+
+   static constexpr uint32_t weeks_per_year    = 52;
+   static constexpr uint32_t max_years         = 63;       // last year of the block timestamp epoch the multiplier covers
+   static constexpr int64_t  votepay_period_us = 500'000;  // votepay share time unit, the block interval
+
+   /**
+    * `2 ^ (k / 52)` for `k` in `[0, 52)` as Q1.63 fixed-point numbers, rounded to nearest.
+    */
+   static constexpr uint64_t weekly_multiplier[weeks_per_year] = {
+      0x8000000000000000ull, 0x81b7b6a7191e9728ull, 0x837553d6191185b7ull, 0x8538ebd2116fa1e7ull,
+      0x87029325b59ec05bull, 0x88d25ea24a08050aull, 0x8aa863609681eee8ull, 0x8c84b6c1dbfb252dull,
+      0x8e676e70cd7132faull, 0x9050a0628c3e847aull, 0x924062d7a7cb1f85ull, 0x9436cc5d20abb938ull,
+      0x9633f3cd6f3af1ebull, 0x9837f0518db8a96full, 0x9a42d96205fb867cull, 0x9c54c6c802c0f5d4ull,
+      0x9e6dd09e64a80fcbull, 0xa08e0f52dae3fd8bull, 0xa2b59ba6ffb2a2b3ull, 0xa4e48eb178a47bedull,
+      0xa71b01df1ac2cf4dull, 0xa9590ef412a1789aull, 0xab9ed00d1069c91bull, 0xadec5fa077ec20d3ull,
+      0xb041d87f94c61602ull, 0xb29f55d7d2ab2f3cull, 0xb504f333f9de6484ull, 0xb772cc7d6feaccc7ull,
+      0xb9e8fdfd7caa0e56ull, 0xbc67a45e93a75b50ull, 0xbeeedcada1edf584ull, 0xc17ec45b605268fbull,
+      0xc417793daa45e05cull, 0xc6b91990d9432b52ull, 0xc963c3f924e544a4ull, 0xcc17978407b75bf5ull,
+      0xced4b3a9a8ce9e30ull, 0xd19b384e4a3e2f64ull, 0xd46b45c3bc760147ull, 0xd744fccad69d6af4ull,
+      0xda287e94f3faa066ull, 0xdd15ecc57678630eull, 0xe00d69734e5b807dull, 0xe30f172a8739f07dull,
+      0xe61b18edda45a129ull, 0xe931923845fd3d9aull, 0xec52a6feab557aa1ull, 0xef7e7bb1706db4bdull,
+      0xf2b5353e28e2eafbull, 0xf5f6f91143d463f5ull, 0xf943ed17bfad8c5bull, 0xfc9c37c0e3c8e1afull
+   };
+
+   namespace detail {
+
+      /// number of significant bits of `v`
+      inline int bit_width( uint128 v ) {
+         const uint64_t hi = uint64_t(v >> 64);
+         const uint64_t lo = uint64_t(v);
+         if( hi ) return 128 - __builtin_clzll(hi);
+         if( lo ) return 64 - __builtin_clzll(lo);
+         return 0;
+      }
+
+   } /// namespace detail
+
+   /**
+    * `2 ^ (weeks / 52)` as the Q1.63 factor of the week of the year and the shift that applies the whole years.
+    */
+   struct multiplier {
+      uint64_t factor;
+      uint32_t shift;
+   };
+
+   /**
+    * Multiplier of the vote weights at `weeks` whole weeks after the block timestamp epoch, saturated at
+    * the last week of year `max_years`.
+    */
+   inline multiplier weekly( uint32_t weeks ) {
+      if( weeks >= max_years * weeks_per_year ) weeks = max_years * weeks_per_year - 1;
+      return { weekly_multiplier[weeks % weeks_per_year], 63 - weeks / weeks_per_year };
+   }
+
+   /**
+    * Vote weight of `staked` tokens with the multiplier `m`, `floor(staked * 2 ^ (weeks / 52))`.
+    *
+    * @pre `staked >= 0`
+    */
+   inline int128 stake_to_weight( int64_t staked, const multiplier& m ) {
+      return int128( ( uint128(uint64_t(staked)) * m.factor ) >> m.shift );
+   }
+
+   /**
+    * Vote weight of `staked` tokens at `weeks` whole weeks after the block timestamp epoch.
+    *
+    * @pre `staked >= 0`
+    */
+   inline int128 stake_to_weight( int64_t staked, uint32_t weeks ) {
+      return stake_to_weight( staked, weekly( weeks ) );
+   }
+
+   /**
+    * Votepay shares accrued by holding `weight` during `elapsed_us` microseconds.
+    */
+   inline int128 accrue( int128 weight, int64_t elapsed_us ) {
+      return weight * ( elapsed_us / votepay_period_us );
+   }
+
+   /**
+    * `floor(amount * part / whole)`, with `part` and `whole` reduced to 64 significant bits first so that
+    * the product cannot overflow. Used to split a bucket of tokens pro rata to vote weights or shares.
+    *
+    * @pre `amount >= 0`, `part >= 0` and `whole > 0`
+    */
+   inline int64_t pro_rata( int64_t amount, int128 part, int128 whole ) {
+      const int bits  = detail::bit_width( uint128(part > whole ? part : whole) );
+      const int shift = bits > 64 ? bits - 64 : 0;
+      const uint128 p = uint128(part)  >> shift;
+      const uint128 w = uint128(whole) >> shift;
+      if( w == 0 ) return amount;
+      const uint128 r = uint128(uint64_t(amount)) * p / w;
+      return r > uint128(std::numeric_limits<int64_t>::max()) ? std::numeric_limits<int64_t>::max() : int64_t(r);
+   }
+
+   /**
+    * Vote weight or votepay share held by one of the former double precision fields. Negative values,
+    * left behind by floating point rounding, are read as zero.
+    */
+   inline int128 from_double( double v ) {
+      if( !(v > 0) ) return 0;
+      if( v >= 0x1p126 ) return int128(1) << 126;
+      return int128(v);
+   }
+
+   /// double precision value stored next to a fixed-point vote weight for table readers
+   inline double to_double( int128 v ) {
+      return double(v);
+   }
+
+   /// votepay share in vote weight seconds, the unit of the double precision votepay fields
+   inline double share_to_double( int128 v ) {
+      return double(v) * ( double(votepay_period_us) / 1'000'000 );
+   }
+
+   /// votepay share held by one of the former double precision votepay fields
+   inline int128 share_from_double( double v ) {
+      return from_double( v * ( 1'000'000 / double(votepay_period_us) ) );
+   }
+
+} } /// namespace arisensystem::vote_weight
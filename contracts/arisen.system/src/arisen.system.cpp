@@ -4,6 +4,9 @@
 #include <arisen/crypto.hpp>
 #include <arisen/dispatcher.hpp>
 
+#include <boost/preprocessor/seq/for_each.hpp>
+#include <boost/preprocessor/stringize.hpp>
+
 namespace arisensystem {
 
    using arisen::current_time_point;
@@ -11,12 +14,22 @@ namespace arisensystem {
 
    system_contract::system_contract( name s, name code, datastream<const char*> ds )
    :native(s,code,ds),
+    _legacy_voters(get_self(), get_self().value),
     _voters(get_self(), get_self().value),
+    _pending_proxies(get_self(), get_self().value),
+    _pending_stakes(get_self(), get_self().value),
+    _vote_sets(get_self(), get_self().value),
+    _pending_vote_sets(get_self(), get_self().value),
     _producers(get_self(), get_self().value),
     _producers2(get_self(), get_self().value),
+    _producer_stats(get_self(), get_self().value),
+    _producer_config(get_self(), get_self().value),
     _global(get_self(), get_self().value),
     _global2(get_self(), get_self().value),
     _global3(get_self(), get_self().value),
+    _global_record(get_self(), get_self().value),
+    _unpaid_blocks(get_self(), get_self().value),
+    _producer_ranking(get_self(), get_self().value),
     _rammarket(get_self(), get_self().value),
     _compool(get_self(), get_self().value),
     _comfunds(get_self(), get_self().value),
@@ -24,9 +37,7 @@ namespace arisensystem {
     _comorders(get_self(), get_self().value)
    {
       //print( "construct system\n" );
-      _gstate  = _global.exists() ? _global.get() : get_default_parameters();
-      _gstate2 = _global2.exists() ? _global2.get() : arisen_global_state2{};
-      _gstate3 = _global3.exists() ? _global3.get() : arisen_global_state3{};
+      // global state is not read here, it is loaded on first use by gstate(), gstate2() and gstate3()
    }
 
    arisen_global_state system_contract::get_default_parameters() {
@@ -35,25 +46,247 @@ namespace arisensystem {
       return dp;
    }
 
+   /**
+    *  Determines, on first use, where the global state is stored. Once the `globalstate` record
+    *  exists (after `mergeglobals`, or on chains initialized with it) the whole state is loaded with
+    *  a single lookup. A record that does not exist yet is marked dirty so that it gets created on
+    *  destruction.
+    */
+   bool system_contract::legacy_gstate() {
+      if( !_legacy_gstate ) {
+         const bool has_record = _global_record.exists();
+         _legacy_gstate = !has_record && _global.exists();
+         if( !*_legacy_gstate ) {
+            if( has_record ) {
+               auto record = _global_record.get();
+               _gstate  = std::move(record.gstate);
+               _gstate2 = std::move(record.gstate2);
+               _gstate3 = std::move(record.gstate3);
+               if( record.vote_totals.has_value() )
+                  _vote_totals = record.vote_totals.value();
+               if( record.election.has_value() )
+                  _election = record.election.value();
+               if( record.schedule.has_value() )
+                  _schedule = record.schedule.value();
+               if( record.vote_debounce.has_value() )
+                  _vote_debounce = record.vote_debounce.value();
+               if( record.name_auction.has_value() )
+                  _name_auction = record.name_auction.value();
+               if( record.payout.has_value() )
+                  _payout = record.payout.value();
+            } else {
+               _gstate  = get_default_parameters();
+               _gstate2 = arisen_global_state2{};
+               _gstate3 = arisen_global_state3{};
+               _gstate_dirty = true;
+            }
+         }
+      }
+      return *_legacy_gstate;
+   }
+
+   /**
+    *  Global state is loaded the first time an action reads it. Until `mergeglobals` has run, each
+    *  legacy singleton is read on demand and a singleton that does not exist yet is marked dirty so
+    *  that its row gets created on destruction. Only the parts listed in the action's
+    *  `action_state_manifest()` entry may be accessed.
+    */
+   const arisen_global_state& system_contract::gstate() {
+      check( has_field( declared_state, state_fields::global ), "action does not declare global state in its manifest" );
+      if( !_gstate && legacy_gstate() ) {
+         _gstate_dirty = !_global.exists();
+         _gstate = _gstate_dirty ? get_default_parameters() : _global.get();
+      }
+      return *_gstate;
+   }
+
+   const arisen_global_state2& system_contract::gstate2() {
+      check( has_field( declared_state, state_fields::global2 ), "action does not declare global2 state in its manifest" );
+      if( !_gstate2 && legacy_gstate() ) {
+         _gstate2_dirty = !_global2.exists();
+         _gstate2 = _gstate2_dirty ? arisen_global_state2{} : _global2.get();
+      }
+      return *_gstate2;
+   }
+
+   const arisen_global_state3& system_contract::gstate3() {
+      check( has_field( declared_state, state_fields::global3 ), "action does not declare global3 state in its manifest" );
+      if( !_gstate3 && legacy_gstate() ) {
+         _gstate3_dirty = !_global3.exists();
+         _gstate3 = _gstate3_dirty ? arisen_global_state3{} : _global3.get();
+      }
+      return *_gstate3;
+   }
+
+   arisen_global_state& system_contract::mutable_gstate() {
+      gstate();
+      _gstate_dirty = true;
+      return *_gstate;
+   }
+
+   arisen_global_state2& system_contract::mutable_gstate2() {
+      gstate2();
+      _gstate2_dirty = true;
+      return *_gstate2;
+   }
+
+   arisen_global_state3& system_contract::mutable_gstate3() {
+      gstate3();
+      _gstate3_dirty = true;
+      return *_gstate3;
+   }
+
+   /**
+    *  Fixed-point vote totals are stored with the consolidated record. A record written before they
+    *  existed, as well as the legacy singletons, only hold the double precision totals, which the
+    *  fixed-point ones are derived from. Callers modify them through update_total_vote_weight() and
+    *  update_total_votepay_share(), which keep the double precision fields in sync.
+    */
+   static fixed_vote_totals derive_vote_totals( const arisen_global_state& gs, const arisen_global_state2& gs2,
+                                                const arisen_global_state3& gs3 ) {
+      return fixed_vote_totals{ vote_weight::from_double( gs.total_producer_vote_weight ),
+                                vote_weight::share_from_double( gs2.total_producer_votepay_share ),
+                                vote_weight::from_double( gs3.total_vpay_share_change_rate ) };
+   }
+
+   const fixed_vote_totals& system_contract::vote_totals() {
+      const auto& gs = gstate(); // loads the record, which may carry the totals
+      if( !_vote_totals ) {
+         _vote_totals = derive_vote_totals( gs, gstate2(), gstate3() );
+      }
+      return *_vote_totals;
+   }
+
+   /**
+    *  Election state is part of the global state and stored with the consolidated record. While the
+    *  legacy singletons are in use it is not stored, and every election starts from the default state,
+    *  which scans the producers and proposes the schedule.
+    */
+   const election_state& system_contract::election() {
+      gstate(); // loads the record
+      if( !_election ) {
+         _election = election_state{};
+      }
+      return *_election;
+   }
+
+   election_state& system_contract::mutable_election() {
+      election();
+      _gstate_dirty = true;
+      return *_election;
+   }
+
+   /**
+    *  Schedule parameters are stored with the consolidated record. Until it exists, the producers are
+    *  proposed in name order.
+    */
+   const schedule_parameters& system_contract::schedule_params() {
+      gstate(); // loads the record
+      if( !_schedule ) {
+         _schedule = schedule_parameters{};
+      }
+      return *_schedule;
+   }
+
+   /**
+    *  Vote debounce parameters are stored with the consolidated record. Until it exists, every stake
+    *  change is cast right away.
+    */
+   const vote_debounce_parameters& system_contract::vote_debounce() {
+      gstate(); // loads the record
+      if( !_vote_debounce ) {
+         _vote_debounce = vote_debounce_parameters{};
+      }
+      return *_vote_debounce;
+   }
+
+   vote_debounce_parameters& system_contract::mutable_vote_debounce() {
+      vote_debounce();
+      _gstate_dirty = true;
+      return *_vote_debounce;
+   }
+
+   /**
+    *  The name auction mirror is stored with the consolidated record. Until it exists the mirror is
+    *  stale on every action and the name closing check reads the `highbid` index.
+    */
+   const name_auction_state& system_contract::name_auction() {
+      gstate(); // loads the record
+      if( !_name_auction ) {
+         _name_auction = name_auction_state{};
+      }
+      return *_name_auction;
+   }
+
+   name_auction_state& system_contract::mutable_name_auction() {
+      name_auction();
+      _gstate_dirty = true;
+      return *_name_auction;
+   }
+
+   /**
+    *  The pay settlement is stored with the consolidated record. Until it exists no settlement has run and
+    *  claims fund the pay buckets themselves.
+    */
+   const payout_state& system_contract::payout() {
+      gstate(); // loads the record
+      if( !_payout ) {
+         _payout = payout_state{};
+      }
+      return *_payout;
+   }
+
+   payout_state& system_contract::mutable_payout() {
+      payout();
+      _gstate_dirty = true;
+      return *_payout;
+   }
+
    symbol system_contract::core_symbol()const {
       const static auto sym = get_core_symbol( _rammarket );
       return sym;
    }
 
    system_contract::~system_contract() {
-      _global.set( _gstate, get_self() );
-      _global2.set( _gstate2, get_self() );
-      _global3.set( _gstate3, get_self() );
+      if( _ranking_dirty )
+         _producer_ranking.set( *_ranking, get_self() );
+
+      if( !_legacy_gstate )
+         return; // global state was not touched by the action
+
+      if( !*_legacy_gstate ) {
+         if( _gstate_dirty || _gstate2_dirty || _gstate3_dirty ) {
+            arisen_global_record record{ global_record_version, *_gstate, *_gstate2, *_gstate3 };
+            // extensions are stored in order, the ones not loaded by the action are stored with their defaults
+            // and the record holds all parts of the state the totals are derived from
+            record.vote_totals.emplace( _vote_totals ? *_vote_totals : derive_vote_totals( *_gstate, *_gstate2, *_gstate3 ) );
+            record.election.emplace( _election ? *_election : election_state{} );
+            record.schedule.emplace( _schedule ? *_schedule : schedule_parameters{} );
+            record.vote_debounce.emplace( _vote_debounce ? *_vote_debounce : vote_debounce_parameters{} );
+            record.name_auction.emplace( _name_auction ? *_name_auction : name_auction_state{} );
+            record.payout.emplace( _payout ? *_payout : payout_state{} );
+            _global_record.set( record, get_self() );
+         }
+         return;
+      }
+
+      // only rewrite the legacy singletons that were actually modified by the action
+      if( _gstate_dirty )
+         _global.set( *_gstate, get_self() );
+      if( _gstate2_dirty )
+         _global2.set( *_gstate2, get_self() );
+      if( _gstate3_dirty )
+         _global3.set( *_gstate3, get_self() );
    }
 
    void system_contract::setram( uint64_t max_ram_size ) {
       require_auth( get_self() );
 
-      check( _gstate.max_ram_size < max_ram_size, "ram may only be increased" ); /// decreasing ram might result market maker issues
+      check( gstate().max_ram_size < max_ram_size, "ram may only be increased" ); /// decreasing ram might result market maker issues
       check( max_ram_size < 1024ll*1024*1024*1024*1024, "ram size is unrealistic" );
-      check( max_ram_size > _gstate.total_ram_bytes_reserved, "attempt to set max below reserved" );
+      check( max_ram_size > gstate().total_ram_bytes_reserved, "attempt to set max below reserved" );
 
-      auto delta = int64_t(max_ram_size) - int64_t(_gstate.max_ram_size);
+      auto delta = int64_t(max_ram_size) - int64_t(gstate().max_ram_size);
       auto itr = _rammarket.find(ramcore_symbol.raw());
 
       /**
@@ -63,17 +296,18 @@ namespace arisensystem {
          m.base.balance.amount += delta;
       });
 
-      _gstate.max_ram_size = max_ram_size;
+      mutable_gstate().max_ram_size = max_ram_size;
    }
 
    void system_contract::update_ram_supply() {
       auto cbt = arisen::current_block_time();
 
-      if( cbt <= _gstate2.last_ram_increase ) return;
+      if( cbt <= gstate2().last_ram_increase ) return;
 
+      auto& gs2 = mutable_gstate2();
       auto itr = _rammarket.find(ramcore_symbol.raw());
-      auto new_ram = (cbt.slot - _gstate2.last_ram_increase.slot)*_gstate2.new_ram_per_block;
-      _gstate.max_ram_size += new_ram;
+      auto new_ram = (cbt.slot - gs2.last_ram_increase.slot)*gs2.new_ram_per_block;
+      mutable_gstate().max_ram_size += new_ram;
 
       /**
        *  Increase the amount of ram for sale based upon the change in max ram size.
@@ -81,23 +315,47 @@ namespace arisensystem {
       _rammarket.modify( itr, same_payer, [&]( auto& m ) {
          m.base.balance.amount += new_ram;
       });
-      _gstate2.last_ram_increase = cbt;
+      gs2.last_ram_increase = cbt;
    }
 
    void system_contract::setramrate( uint16_t bytes_per_block ) {
       require_auth( get_self() );
 
       update_ram_supply();
-      _gstate2.new_ram_per_block = bytes_per_block;
+      mutable_gstate2().new_ram_per_block = bytes_per_block;
    }
 
    void system_contract::setparams( const arisen::blockchain_parameters& params ) {
       require_auth( get_self() );
-      (arisen::blockchain_parameters&)(_gstate) = params;
-      check( 3 <= _gstate.max_authority_depth, "max_authority_depth should be at least 3" );
+      auto& gs = mutable_gstate();
+      (arisen::blockchain_parameters&)(gs) = params;
+      check( 3 <= gs.max_authority_depth, "max_authority_depth should be at least 3" );
       set_blockchain_parameters( params );
    }
 
+   void system_contract::setschedord( uint8_t order ) {
+      require_auth( get_self() );
+
+      check( order < producer_schedule::order_count, "unknown schedule order" );
+      check( !legacy_gstate(), "global state must be merged first" );
+      check( schedule_params().order != order, "schedule order is already set" );
+
+      _schedule->order = order;
+      mutable_election().ranking_changed = true; // the next election proposes the producers in the new order
+   }
+
+   void system_contract::setvotedelta( int64_t min_stake_delta, uint16_t min_stake_delta_bp ) {
+      require_auth( get_self() );
+
+      check( 0 <= min_stake_delta, "min_stake_delta cannot be negative" );
+      check( min_stake_delta_bp <= 10000, "min_stake_delta_bp cannot exceed 10000" );
+      check( !legacy_gstate(), "global state must be merged first" );
+
+      auto& params = mutable_vote_debounce();
+      params.min_stake_delta    = min_stake_delta;
+      params.min_stake_delta_bp = min_stake_delta_bp;
+   }
+
    void system_contract::setpriv( const name& account, uint8_t ispriv ) {
       require_auth( get_self() );
       set_privileged( account, ispriv );
@@ -110,11 +368,11 @@ namespace arisensystem {
       auto ritr = userres.find( account.value );
       check( ritr == userres.end(), "only supports unlimited accounts" );
 
-      auto vitr = _voters.find( account.value );
+      auto vitr = find_voter( account );
       if( vitr != _voters.end() ) {
-         bool ram_managed = has_field( vitr->flags1, voter_info::flags1_fields::ram_managed );
-         bool net_managed = has_field( vitr->flags1, voter_info::flags1_fields::net_managed );
-         bool cpu_managed = has_field( vitr->flags1, voter_info::flags1_fields::cpu_managed );
+         bool ram_managed = has_field( vitr->flags, voter_info2::flags_fields::ram_managed );
+         bool net_managed = has_field( vitr->flags, voter_info2::flags_fields::net_managed );
+         bool cpu_managed = has_field( vitr->flags, voter_info2::flags_fields::cpu_managed );
          check( !(ram_managed || net_managed || cpu_managed), "cannot use setalimits on an account with managed resources" );
       }
 
@@ -130,8 +388,8 @@ namespace arisensystem {
       int64_t ram = 0;
 
       if( !ram_bytes ) {
-         auto vitr = _voters.find( account.value );
-         check( vitr != _voters.end() && has_field( vitr->flags1, voter_info::flags1_fields::ram_managed ),
+         auto vitr = find_voter( account );
+         check( vitr != _voters.end() && has_field( vitr->flags, voter_info2::flags_fields::ram_managed ),
                 "RAM of account is already unmanaged" );
 
          user_resources_table userres( get_self(), account.value );
@@ -143,20 +401,20 @@ namespace arisensystem {
          }
 
          _voters.modify( vitr, same_payer, [&]( auto& v ) {
-            v.flags1 = set_field( v.flags1, voter_info::flags1_fields::ram_managed, false );
+            v.flags = set_field( v.flags, voter_info2::flags_fields::ram_managed, false );
          });
       } else {
          check( *ram_bytes >= 0, "not allowed to set RAM limit to unlimited" );
 
-         auto vitr = _voters.find( account.value );
+         auto vitr = find_voter( account );
          if ( vitr != _voters.end() ) {
             _voters.modify( vitr, same_payer, [&]( auto& v ) {
-               v.flags1 = set_field( v.flags1, voter_info::flags1_fields::ram_managed, true );
+               v.flags = set_field( v.flags, voter_info2::flags_fields::ram_managed, true );
             });
          } else {
             _voters.emplace( account, [&]( auto& v ) {
                v.owner  = account;
-               v.flags1 = set_field( v.flags1, voter_info::flags1_fields::ram_managed, true );
+               v.flags  = set_field( v.flags, voter_info2::flags_fields::ram_managed, true );
             });
          }
 
@@ -175,8 +433,8 @@ namespace arisensystem {
       int64_t net = 0;
 
       if( !net_weight ) {
-         auto vitr = _voters.find( account.value );
-         check( vitr != _voters.end() && has_field( vitr->flags1, voter_info::flags1_fields::net_managed ),
+         auto vitr = find_voter( account );
+         check( vitr != _voters.end() && has_field( vitr->flags, voter_info2::flags_fields::net_managed ),
                 "Network bandwidth of account is already unmanaged" );
 
          user_resources_table userres( get_self(), account.value );
@@ -187,20 +445,20 @@ namespace arisensystem {
          }
 
          _voters.modify( vitr, same_payer, [&]( auto& v ) {
-            v.flags1 = set_field( v.flags1, voter_info::flags1_fields::net_managed, false );
+            v.flags = set_field( v.flags, voter_info2::flags_fields::net_managed, false );
          });
       } else {
          check( *net_weight >= -1, "invalid value for net_weight" );
 
-         auto vitr = _voters.find( account.value );
+         auto vitr = find_voter( account );
          if ( vitr != _voters.end() ) {
             _voters.modify( vitr, same_payer, [&]( auto& v ) {
-               v.flags1 = set_field( v.flags1, voter_info::flags1_fields::net_managed, true );
+               v.flags = set_field( v.flags, voter_info2::flags_fields::net_managed, true );
             });
          } else {
             _voters.emplace( account, [&]( auto& v ) {
                v.owner  = account;
-               v.flags1 = set_field( v.flags1, voter_info::flags1_fields::net_managed, true );
+               v.flags  = set_field( v.flags, voter_info2::flags_fields::net_managed, true );
             });
          }
 
@@ -219,8 +477,8 @@ namespace arisensystem {
       int64_t cpu = 0;
 
       if( !cpu_weight ) {
-         auto vitr = _voters.find( account.value );
-         check( vitr != _voters.end() && has_field( vitr->flags1, voter_info::flags1_fields::cpu_managed ),
+         auto vitr = find_voter( account );
+         check( vitr != _voters.end() && has_field( vitr->flags, voter_info2::flags_fields::cpu_managed ),
                 "CPU bandwidth of account is already unmanaged" );
 
          user_resources_table userres( get_self(), account.value );
@@ -231,20 +489,20 @@ namespace arisensystem {
          }
 
          _voters.modify( vitr, same_payer, [&]( auto& v ) {
-            v.flags1 = set_field( v.flags1, voter_info::flags1_fields::cpu_managed, false );
+            v.flags = set_field( v.flags, voter_info2::flags_fields::cpu_managed, false );
          });
       } else {
          check( *cpu_weight >= -1, "invalid value for cpu_weight" );
 
-         auto vitr = _voters.find( account.value );
+         auto vitr = find_voter( account );
          if ( vitr != _voters.end() ) {
             _voters.modify( vitr, same_payer, [&]( auto& v ) {
-               v.flags1 = set_field( v.flags1, voter_info::flags1_fields::cpu_managed, true );
+               v.flags = set_field( v.flags, voter_info2::flags_fields::cpu_managed, true );
             });
          } else {
             _voters.emplace( account, [&]( auto& v ) {
                v.owner  = account;
-               v.flags1 = set_field( v.flags1, voter_info::flags1_fields::cpu_managed, true );
+               v.flags  = set_field( v.flags, voter_info2::flags_fields::cpu_managed, true );
             });
          }
 
@@ -261,20 +519,33 @@ namespace arisensystem {
 
    void system_contract::rmvproducer( const name& producer ) {
       require_auth( get_self() );
-      auto prod = _producers.find( producer.value );
-      check( prod != _producers.end(), "producer not found" );
-      _producers.modify( prod, same_payer, [&](auto& p) {
-            p.deactivate();
-         });
+      auto prod = find_producer( producer );
+      check( prod != _producer_stats.end(), "producer not found" );
+      deactivate_producer( prod );
    }
 
    void system_contract::updtrevision( uint8_t revision ) {
       require_auth( get_self() );
-      check( _gstate2.revision < 255, "can not increment revision" ); // prevent wrap around
-      check( revision == _gstate2.revision + 1, "can only increment revision by one" );
+      check( gstate2().revision < 255, "can not increment revision" ); // prevent wrap around
+      check( revision == gstate2().revision + 1, "can only increment revision by one" );
       check( revision <= 1, // set upper bound to greatest revision supported in the code
                     "specified revision is not yet supported by the code" );
-      _gstate2.revision = revision;
+      mutable_gstate2().revision = revision;
+   }
+
+   void system_contract::mergeglobals() {
+      require_auth( get_self() );
+
+      check( !_global_record.exists(), "global state has already been merged" );
+      check( _global.exists(), "system contract must first be initialized" );
+
+      _global_record.set( arisen_global_record{ global_record_version,
+                                                _global.get(),
+                                                _global2.get_or_default(),
+                                                _global3.get_or_default() }, get_self() );
+      _global.remove();
+      _global2.remove();
+      _global3.remove();
    }
 
 
@@ -356,7 +627,7 @@ namespace arisensystem {
       _rammarket.emplace( get_self(), [&]( auto& m ) {
          m.supply.amount = 100000000000000ll;
          m.supply.symbol = ramcore_symbol;
-         m.base.balance.amount = int64_t(_gstate.free_ram());
+         m.base.balance.amount = int64_t(gstate().free_ram());
          m.base.balance.symbol = ram_symbol;
          m.quote.balance.amount = system_token_supply.amount / 1000;
          m.quote.balance.symbol = core;
@@ -364,6 +635,63 @@ namespace arisensystem {
 
       token::open_action open_act{ token_account, { {get_self(), active_permission} } };
       open_act.send( com_account, core, get_self() );
+
+      // make sure all global state rows exist from the start, later actions only load what they use
+      mutable_gstate();
+      mutable_gstate2();
+      mutable_gstate3();
    }
 
 } /// arisen.system
+
+// actions of the contract, grouped by the source file that defines them
+#define ARISEN_SYSTEM_ACTIONS \
+   /* native.hpp */ \
+   (newaccount)(updateauth)(deleteauth)(linkauth)(unlinkauth)(canceldelay)(onerror)(setabi)(setcode) \
+   /* arisen.system.cpp */ \
+   (init)(setram)(setramrate)(setparams)(setpriv)(setalimits)(setacctram)(setacctnet)(setacctcpu)(activate) \
+   (rmvproducer)(updtrevision)(mergeglobals)(migrateprods)(setschedord)(setvotedelta) \
+   /* delegate_bandwidth.cpp */ \
+   (buyrambytes)(buyram)(buyrambatch)(sellram)(delegatebw)(undelegatebw)(refund) \
+   /* voting.cpp */ \
+   (regproducer)(unregprod)(voteproducer)(bulkvote)(regproxy)(flushproxies)(flushvotesets)(migratevotes) \
+   /* producer_pay.cpp */ \
+   (claimrewards)(settlepay)(claimtostake)(claimtocom) \
+   /* name_bidding.cpp */ \
+   (bidname)(bidrefund) \
+   /* com.cpp */ \
+   (deposit)(withdraw)(buycom)(unstaketocom)(sellcom)(cnclcomorder)(rentcpu)(rentnet)(fundcpuloan) \
+   (fundnetloan)(defcpuloan)(defnetloan)(updatecom)(setcom)(comexec)(consolidate)(mvtosavings) \
+   (mvfrsavings)(closecom)
+
+// a dispatched action without an entry in action_state_manifest() is a compile error, not a failure on chain
+#define ARISEN_SYSTEM_CHECK_MANIFEST( r, DUMMY, elem ) \
+   static_assert( arisensystem::action_state_manifest( arisen::name( BOOST_PP_STRINGIZE(elem) ) ) != arisensystem::unlisted_manifest, \
+                  "action " BOOST_PP_STRINGIZE(elem) " has no entry in action_state_manifest()" );
+
+BOOST_PP_SEQ_FOR_EACH( ARISEN_SYSTEM_CHECK_MANIFEST, DUMMY, ARISEN_SYSTEM_ACTIONS (onblock) )
+
+extern "C" void apply( uint64_t receiver, uint64_t code, uint64_t action ) {
+   using namespace arisensystem;
+
+   if( code != receiver )
+      return;
+
+   system_contract::declared_state = action_state_manifest( name(action) );
+
+   // onblock runs in every block: only unpack the leading timestamp and producer of the block header
+   // instead of copying the whole header through the generic dispatcher
+   if( action == "onblock"_n.value ) {
+      char buffer[sizeof(uint32_t) + sizeof(uint64_t)];
+      check( arisen::read_action_data( buffer, sizeof(buffer) ) == sizeof(buffer), "invalid onblock header" );
+      arisen::datastream<const char*> ds( buffer, sizeof(buffer) );
+      system_contract( name(receiver), name(code), ds ).onblock( ignore<block_header>() );
+      return;
+   }
+
+   switch( action ) {
+      ARISEN_DISPATCH_HELPER( arisensystem::system_contract, ARISEN_SYSTEM_ACTIONS )
+      default:
+         check( false, "unknown action" );
+   }
+}
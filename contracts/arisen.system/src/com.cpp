@@ -388,10 +388,10 @@ namespace arisensystem {
          bool net_managed = false;
          bool cpu_managed = false;
 
-         auto voter_itr = _voters.find( receiver.value );
+         auto voter_itr = find_voter( receiver );
          if( voter_itr != _voters.end() ) {
-            net_managed = has_field( voter_itr->flags1, voter_info::flags1_fields::net_managed );
-            cpu_managed = has_field( voter_itr->flags1, voter_info::flags1_fields::cpu_managed );
+            net_managed = has_field( voter_itr->flags, voter_info2::flags_fields::net_managed );
+            cpu_managed = has_field( voter_itr->flags, voter_info2::flags_fields::cpu_managed );
          }
 
          if( !(net_managed && cpu_managed) ) {
@@ -417,10 +417,10 @@ namespace arisensystem {
     * @param owner - account buying or already holding COM tokens
     * @err_msg - error message
     */
-   void system_contract::check_voting_requirement( const name& owner, const char* error_msg )const
+   void system_contract::check_voting_requirement( const name& owner, const char* error_msg )
    {
-      auto vitr = _voters.find( owner.value );
-      check( vitr != _voters.end() && ( vitr->proxy || 21 <= vitr->producers.size() ), error_msg );
+      auto vitr = find_voter( owner );
+      check( vitr != _voters.end() && ( vitr->proxy || 21 <= voted_producers( *vitr ).size() ), error_msg );
    }
 
    /**
@@ -1070,7 +1070,7 @@ namespace arisensystem {
       }
 
       if ( delta_stake != 0 ) {
-         auto vitr = _voters.find( voter.value );
+         auto vitr = find_voter( voter );
          if ( vitr != _voters.end() ) {
             _voters.modify( vitr, same_payer, [&]( auto& vinfo ) {
                vinfo.staked += delta_stake;
@@ -79,9 +79,106 @@ namespace arisensystem {
 
       check( bytes_out > 0, "must reserve a positive amount" );
 
-      _gstate.total_ram_bytes_reserved += uint64_t(bytes_out);
-      _gstate.total_ram_stake          += quant_after_fee.amount;
+      auto& gs = mutable_gstate();
+      gs.total_ram_bytes_reserved += uint64_t(bytes_out);
+      gs.total_ram_stake          += quant_after_fee.amount;
 
+      add_ram( receiver, bytes_out );
+   }
+
+   void system_contract::buyrambatch( const name& payer, const std::vector<ram_purchase>& purchases )
+   {
+      require_auth( payer );
+      update_ram_supply();
+
+      check( !purchases.empty(), "no purchases specified" );
+
+      const auto& market = _rammarket.get(ramcore_symbol.raw(), "ram market does not exist");
+      const int64_t ram_reserve = market.base.balance.amount;
+      const int64_t rsn_reserve = market.quote.balance.amount;
+
+      int64_t total_bytes = 0;
+      int64_t total_quant = 0;
+      for( const auto& p : purchases ) {
+         check( is_account( p.receiver ), "receiver account does not exist" );
+         check( p.bytes >= 0, "cannot purchase a negative amount of bytes" );
+         if( p.bytes > 0 ) {
+            check( p.quant.amount == 0, "each purchase must specify either bytes or a quantity" );
+            check( p.bytes < ram_reserve - total_bytes, "batch exceeds the ram market" );
+            total_bytes += p.bytes;
+         } else {
+            check( p.quant.symbol == core_symbol(), "must buy ram with core token" );
+            check( p.quant.amount > 0, "must purchase a positive amount" );
+            check( p.quant.amount <= asset::max_amount - total_quant, "batch quantity overflow" );
+            total_quant += p.quant.amount;
+         }
+      }
+
+      // the bytes purchases are priced together, as one buyrambytes of their sum, and the .5% fee is added
+      // back by rounding cost * 200 / 199 up, so that what is left after the fee pays for all of them.
+      // get_bancor_input rounds down, the cost is raised to the smallest one that buys all the bytes so that
+      // they are not taken from the quantity purchases of the batch
+      int64_t total = total_quant;
+      if( total_bytes > 0 ) {
+         int64_t cost = exchange_state::get_bancor_input( ram_reserve, rsn_reserve, total_bytes );
+         if( exchange_state::get_bancor_output( rsn_reserve, ram_reserve, cost ) < total_bytes )
+            ++cost;
+         const uint128_t cost_plus_fee = ( uint128_t(cost) * 200 + 198 ) / 199;
+         check( cost > 0, "must purchase a positive amount" );
+         check( cost_plus_fee <= uint128_t(asset::max_amount - total), "batch quantity overflow" );
+         total += int64_t(cost_plus_fee);
+      }
+
+      const asset quant{ total, core_symbol() };
+      auto fee = quant;
+      fee.amount = ( fee.amount + 199 ) / 200; /// .5% fee (round up), charged once for the whole batch
+      auto quant_after_fee = quant;
+      quant_after_fee.amount -= fee.amount;
+      {
+         token::transfer_action transfer_act{ token_account, { {payer, active_permission}, {ram_account, active_permission} } };
+         transfer_act.send( payer, ram_account, quant_after_fee, "buy ram" );
+      }
+      if ( fee.amount > 0 ) {
+         token::transfer_action transfer_act{ token_account, { {payer, active_permission} } };
+         transfer_act.send( payer, ramfee_account, fee, "ram fee" );
+         channel_to_com( ramfee_account, fee );
+      }
+
+      int64_t bytes_out;
+      _rammarket.modify( market, same_payer, [&]( auto& es ) {
+         bytes_out = es.direct_convert( quant_after_fee,  ram_symbol ).amount;
+      });
+
+      check( bytes_out > 0, "must reserve a positive amount" );
+
+      auto& gs = mutable_gstate();
+      gs.total_ram_bytes_reserved += uint64_t(bytes_out);
+      gs.total_ram_stake          += quant_after_fee.amount;
+
+      // bytes purchases get the bytes they ask for and the quantity purchases share the rest in proportion to
+      // their tokens; a batch of bytes purchases only shares all bytes in proportion to the bytes asked for.
+      // Flooring the running sums makes the shares add up to the bytes shared.
+      const bool    by_bytes      = total_quant == 0;
+      const int64_t shared_bytes  = by_bytes ? bytes_out : bytes_out - total_bytes;
+      const int64_t shared_weight = by_bytes ? total_bytes : total_quant;
+      check( shared_bytes > 0, "must reserve a positive amount for every receiver" );
+
+      int64_t weight   = 0;
+      int64_t assigned = 0;
+      for( const auto& p : purchases ) {
+         int64_t share = p.bytes;
+         if( by_bytes || p.bytes == 0 ) {
+            weight += by_bytes ? p.bytes : p.quant.amount;
+            const int64_t upto = ( uint128_t(shared_bytes) * weight ) / shared_weight;
+            share    = upto - assigned;
+            assigned = upto;
+         }
+         check( share > 0, "must reserve a positive amount for every receiver" );
+         add_ram( p.receiver, share );
+      }
+   }
+
+   void system_contract::add_ram( const name& receiver, int64_t bytes ) {
       user_resources_table  userres( get_self(), receiver.value );
       auto res_itr = userres.find( receiver.value );
       if( res_itr ==  userres.end() ) {
@@ -89,16 +186,16 @@ namespace arisensystem {
                res.owner = receiver;
                res.net_weight = asset( 0, core_symbol() );
                res.cpu_weight = asset( 0, core_symbol() );
-               res.ram_bytes = bytes_out;
+               res.ram_bytes = bytes;
             });
       } else {
          userres.modify( res_itr, receiver, [&]( auto& res ) {
-               res.ram_bytes += bytes_out;
+               res.ram_bytes += bytes;
             });
       }
 
-      auto voter_itr = _voters.find( res_itr->owner.value );
-      if( voter_itr == _voters.end() || !has_field( voter_itr->flags1, voter_info::flags1_fields::ram_managed ) ) {
+      auto voter_itr = find_voter( res_itr->owner );
+      if( voter_itr == _voters.end() || !has_field( voter_itr->flags, voter_info2::flags_fields::ram_managed ) ) {
          int64_t ram_bytes, net, cpu;
          get_resource_limits( res_itr->owner, ram_bytes, net, cpu );
          set_resource_limits( res_itr->owner, res_itr->ram_bytes + ram_gift_bytes, net, cpu );
@@ -131,18 +228,19 @@ namespace arisensystem {
 
       check( tokens_out.amount > 1, "token amount received from selling ram is too low" );
 
-      _gstate.total_ram_bytes_reserved -= static_cast<decltype(_gstate.total_ram_bytes_reserved)>(bytes); // bytes > 0 is asserted above
-      _gstate.total_ram_stake          -= tokens_out.amount;
+      auto& gs = mutable_gstate();
+      gs.total_ram_bytes_reserved -= static_cast<decltype(gs.total_ram_bytes_reserved)>(bytes); // bytes > 0 is asserted above
+      gs.total_ram_stake          -= tokens_out.amount;
 
       //// this shouldn't happen, but just in case it does we should prevent it
-      check( _gstate.total_ram_stake >= 0, "error, attempt to unstake more tokens than previously staked" );
+      check( gs.total_ram_stake >= 0, "error, attempt to unstake more tokens than previously staked" );
 
       userres.modify( res_itr, account, [&]( auto& res ) {
           res.ram_bytes -= bytes;
       });
 
-      auto voter_itr = _voters.find( res_itr->owner.value );
-      if( voter_itr == _voters.end() || !has_field( voter_itr->flags1, voter_info::flags1_fields::ram_managed ) ) {
+      auto voter_itr = find_voter( res_itr->owner );
+      if( voter_itr == _voters.end() || !has_field( voter_itr->flags, voter_info2::flags_fields::ram_managed ) ) {
          int64_t ram_bytes, net, cpu;
          get_resource_limits( res_itr->owner, ram_bytes, net, cpu );
          set_resource_limits( res_itr->owner, res_itr->ram_bytes + ram_gift_bytes, net, cpu );
@@ -170,7 +268,7 @@ namespace arisensystem {
    }
 
    void system_contract::changebw( name from, const name& receiver,
-                                   const asset& stake_net_delta, const asset& stake_cpu_delta, bool transfer )
+                                   const asset& stake_net_delta, const asset& stake_cpu_delta, bool transfer, bool funded )
    {
       require_auth( from );
       check( stake_net_delta.amount != 0 || stake_cpu_delta.amount != 0, "should stake non-zero amount" );
@@ -232,11 +330,11 @@ namespace arisensystem {
             bool net_managed = false;
             bool cpu_managed = false;
 
-            auto voter_itr = _voters.find( receiver.value );
+            auto voter_itr = find_voter( receiver );
             if( voter_itr != _voters.end() ) {
-               ram_managed = has_field( voter_itr->flags1, voter_info::flags1_fields::ram_managed );
-               net_managed = has_field( voter_itr->flags1, voter_info::flags1_fields::net_managed );
-               cpu_managed = has_field( voter_itr->flags1, voter_info::flags1_fields::cpu_managed );
+               ram_managed = has_field( voter_itr->flags, voter_info2::flags_fields::ram_managed );
+               net_managed = has_field( voter_itr->flags, voter_info2::flags_fields::net_managed );
+               cpu_managed = has_field( voter_itr->flags, voter_info2::flags_fields::cpu_managed );
             }
 
             if( !(net_managed && cpu_managed) ) {
@@ -255,8 +353,8 @@ namespace arisensystem {
          }
       } // tot_itr can be invalid, should go out of scope
 
-      // create refund or update from existing refund
-      if ( stake_account != source_stake_from ) { //for arisen both transfer and refund make no sense
+      // create refund or update from existing refund, funded stake has already been sent to arisen.stake
+      if ( stake_account != source_stake_from && !funded ) { //for arisen both transfer and refund make no sense
          refunds_table refunds_tbl( get_self(), from.value );
          auto req = refunds_tbl.find( from.value );
 
@@ -349,16 +447,36 @@ namespace arisensystem {
 
    void system_contract::update_voting_power( const name& voter, const asset& total_update )
    {
-      auto voter_itr = _voters.find( voter.value );
+      bool deferred = false;
+      auto voter_itr = find_voter( voter );
       if( voter_itr == _voters.end() ) {
          voter_itr = _voters.emplace( voter, [&]( auto& v ) {
             v.owner  = voter;
             v.staked = total_update.amount;
          });
       } else {
+         const int64_t pending = pending_stake_of( *voter_itr ) + total_update.amount;
+         deferred = voter_itr->has_vote() &&
+                    defer_stake_change( pending, voter_itr->staked + total_update.amount - pending );
          _voters.modify( voter_itr, same_payer, [&]( auto& v ) {
             v.staked += total_update.amount;
          });
+         if( deferred ) {
+            auto pending_itr = _pending_stakes.find( voter.value );
+            if( pending == 0 ) {
+               if( pending_itr != _pending_stakes.end() )
+                  _pending_stakes.erase( pending_itr );
+            } else if( pending_itr != _pending_stakes.end() ) {
+               _pending_stakes.modify( pending_itr, same_payer, [&]( auto& p ) {
+                  p.stake = pending;
+               });
+            } else {
+               _pending_stakes.emplace( voter, [&]( auto& p ) {
+                  p.voter = voter;
+                  p.stake = pending;
+               });
+            }
+         }
       }
 
       check( 0 <= voter_itr->staked, "stake for voting cannot be negative" );
@@ -367,9 +485,25 @@ namespace arisensystem {
          validate_b1_vesting( voter_itr->staked );
       }
 
-      if( voter_itr->producers.size() || voter_itr->proxy ) {
-         update_votes( voter, voter_itr->proxy, voter_itr->producers, false );
+      if( !deferred && voter_itr->has_vote() ) {
+         // copied, as the vote set holding the list may be rewritten
+         const auto producers = voted_producers( *voter_itr );
+         update_votes( voter, voter_itr->proxy, producers, false );
+      }
+   }
+
+   /**
+    *  Decides whether the stake change `pending` accumulated by a voter is left for later, see
+    *  `vote_debounce_parameters`. `voted_stake` is the stake the voter's votes were cast with.
+    */
+   bool system_contract::defer_stake_change( int64_t pending, int64_t voted_stake ) {
+      const auto& params = vote_debounce();
+      if( params.min_stake_delta == 0 && params.min_stake_delta_bp == 0 ) {
+         return false;
       }
+      const int64_t change = pending < 0 ? -pending : pending;
+      return ( params.min_stake_delta == 0 || change < params.min_stake_delta ) &&
+             ( params.min_stake_delta_bp == 0 || int128_t(change) * 10000 < int128_t(voted_stake) * params.min_stake_delta_bp );
    }
 
    void system_contract::delegatebw( const name& from, const name& receiver,
@@ -392,7 +526,7 @@ namespace arisensystem {
       check( unstake_cpu_quantity >= zero_asset, "must unstake a positive amount" );
       check( unstake_net_quantity >= zero_asset, "must unstake a positive amount" );
       check( unstake_cpu_quantity.amount + unstake_net_quantity.amount > 0, "must unstake a positive amount" );
-      check( _gstate.total_activated_stake >= min_activated_stake,
+      check( gstate().total_activated_stake >= min_activated_stake,
              "cannot undelegate bandwidth until the chain is activated (at least 15% of all tokens participate in voting)" );
 
       changebw( from, receiver, -unstake_net_quantity, -unstake_cpu_quantity, false);
@@ -65,6 +65,15 @@ namespace arisensystem {
             b.last_bid_time = current_time_point();
          });
       }
+
+      // bids only ever increase, so the highest auction is either the cached one or this one
+      if( !legacy_gstate() && !name_auction().stale ) {
+         const auto& top = name_auction();
+         if( top.newname == newname || !top.newname || bid.amount > top.high_bid ||
+             (bid.amount == top.high_bid && newname < top.newname) ) {
+            mutable_name_auction() = name_auction_state{ newname, bidder, bid.amount, current_time_point(), false };
+         }
+      }
    }
 
    void system_contract::bidrefund( const name& bidder, const name& newname ) {
@@ -16,164 +16,315 @@ namespace arisensystem {
       name producer;
       _ds >> timestamp >> producer;
 
-      // _gstate2.last_block_num is not used anywhere in the system contract code anymore.
-      // Although this field is deprecated, we will continue updating it for now until the last_block_num field
-      // is eventually completely removed, at which point this line can be removed.
-      _gstate2.last_block_num = timestamp;
+      // global2 is no longer touched here: its only per-block field, the deprecated last_block_num, is not
+      // used anywhere in the system contract code and is left at its last value.
 
       /** until activated stake crosses this threshold no new rewards are paid */
-      if( _gstate.total_activated_stake < min_activated_stake )
+      if( gstate().total_activated_stake < min_activated_stake )
          return;
 
-      if( _gstate.last_pervote_bucket_fill == time_point() )  /// start the presses
-         _gstate.last_pervote_bucket_fill = current_time_point();
+      if( gstate().last_pervote_bucket_fill == time_point() ) { /// start the presses
+         mutable_gstate().last_pervote_bucket_fill = current_time_point();
+      }
 
 
       /**
        * At startup the initial producer may not be one that is registered / elected
        * and therefore there may be no producer object for them.
+       *
+       * The buffer is stored in every block the producer makes, it only spares the larger producer row
+       * and global state until the round moves on.
        */
-      auto prod = _producers.find( producer.value );
-      if ( prod != _producers.end() ) {
-         _gstate.total_unpaid_blocks++;
-         _producers.modify( prod, same_payer, [&](auto& p ) {
-               p.unpaid_blocks++;
-         });
+      auto buffer  = _unpaid_blocks.get_or_default();
+      bool changed = false;
+      if ( buffer.producer != producer ) {
+         changed = flush_unpaid_blocks( buffer );
+         if ( find_producer( producer ) != _producer_stats.end() )
+            buffer.producer = producer;
       }
+      if ( buffer.producer == producer ) {
+         buffer.blocks++;
+         changed = true;
+      }
+      if ( changed )
+         _unpaid_blocks.set( buffer, get_self() );
 
       /// only update block producers once every minute, block_timestamp is in half seconds
-      if( timestamp.slot - _gstate.last_producer_schedule_update.slot > 120 ) {
+      if( timestamp.slot - gstate().last_producer_schedule_update.slot > 120 ) {
          update_elected_producers( timestamp );
 
-         if( (timestamp.slot - _gstate.last_name_close.slot) > blocks_per_day ) {
-            name_bid_table bids(get_self(), get_self().value);
-            auto idx = bids.get_index<"highbid"_n>();
-            auto highest = idx.lower_bound( std::numeric_limits<uint64_t>::max()/2 );
-            if( highest != idx.end() &&
-                highest->high_bid > 0 &&
-                (current_time_point() - highest->last_bid_time) > microseconds(useconds_per_day) &&
-                _gstate.thresh_activated_stake_time > time_point() &&
-                (current_time_point() - _gstate.thresh_activated_stake_time) > microseconds(14 * useconds_per_day)
+         if( (timestamp.slot - gstate().last_name_close.slot) > blocks_per_day ) {
+            if( name_auction().stale )
+               refresh_name_auction();
+
+            const auto& top = name_auction();
+            if( top.high_bid > 0 &&
+                (current_time_point() - top.last_bid_time) > microseconds(useconds_per_day) &&
+                gstate().thresh_activated_stake_time > time_point() &&
+                (current_time_point() - gstate().thresh_activated_stake_time) > microseconds(14 * useconds_per_day)
             ) {
-               _gstate.last_name_close = timestamp;
-               channel_namebid_to_com( highest->high_bid );
-               idx.modify( highest, same_payer, [&]( auto& b ){
+               name_bid_table bids(get_self(), get_self().value);
+               const auto& highest = bids.get( top.newname.value, "highest name auction not found" );
+               mutable_gstate().last_name_close = timestamp;
+               channel_namebid_to_com( highest.high_bid );
+               bids.modify( highest, same_payer, [&]( auto& b ){
                   b.high_bid = -b.high_bid;
                });
+               mutable_name_auction().stale = true;
             }
          }
       }
    }
 
+   /**
+    * Reads the highest open auction from the `highbid` index into the name auction mirror.
+    */
+   void system_contract::refresh_name_auction() {
+      name_bid_table bids(get_self(), get_self().value);
+      auto idx = bids.get_index<"highbid"_n>();
+      auto highest = idx.lower_bound( std::numeric_limits<uint64_t>::max()/2 );
+      name_auction_state state;
+      if( highest != idx.end() && highest->high_bid > 0 ) {
+         state = name_auction_state{ highest->newname, highest->high_bidder, highest->high_bid, highest->last_bid_time };
+      }
+      state.stale = false;
+      if( legacy_gstate() ) {
+         _name_auction = state; // not stored, the index is read again by the next check
+      } else {
+         mutable_name_auction() = state;
+      }
+   }
+
+   /**
+    * Adds the buffered blocks to the producer row and to `total_unpaid_blocks` and empties `buffer`.
+    * Returns whether `buffer` changed, the caller stores it.
+    */
+   bool system_contract::flush_unpaid_blocks( unpaid_blocks_buffer& buffer ) {
+      if ( !buffer.producer )
+         return false;
+
+      auto prod = find_producer( buffer.producer );
+      if ( buffer.blocks > 0 && prod != _producer_stats.end() ) {
+         mutable_gstate().total_unpaid_blocks += buffer.blocks;
+         _producer_stats.modify( prod, same_payer, [&](auto& p ) {
+               p.unpaid_blocks += buffer.blocks;
+         });
+      }
+      buffer = unpaid_blocks_buffer{};
+      return true;
+   }
+
    void system_contract::claimrewards( const name& owner ) {
       require_auth( owner );
 
-      const auto& prod = _producers.get( owner.value );
-      check( prod.active(), "producer does not have an active key" );
+      const auto [block_pay, vote_pay] = take_producer_pay( owner );
+      send_producer_pay( owner, owner, block_pay, vote_pay, "producer" );
+   }
 
-      check( _gstate.total_activated_stake >= min_activated_stake,
-                    "cannot claim rewards until the chain is activated (at least 15% of all tokens participate in voting)" );
+   void system_contract::claimtostake( const name& owner, const name& receiver, bool transfer ) {
+      require_auth( owner );
+      check( !transfer || owner != receiver, "cannot use transfer flag if delegating to self" );
 
-      const auto ct = current_time_point();
+      const auto [block_pay, vote_pay] = take_producer_pay( owner );
+      const int64_t pay = block_pay + vote_pay;
+      check( pay > 0, "no rewards to stake" );
+      send_producer_pay( owner, stake_account, block_pay, vote_pay, "stake producer" );
 
-      check( ct - prod.last_claim_time > microseconds(useconds_per_day), "already claimed rewards within past day" );
+      const asset net( pay / 2, core_symbol() );
+      changebw( owner, receiver, net, asset( pay, core_symbol() ) - net, transfer, true );
+   }
 
-      const asset token_supply   = token::get_supply(token_account, core_symbol().code() );
-      const auto usecs_since_last_fill = (ct - _gstate.last_pervote_bucket_fill).count();
+   void system_contract::claimtocom( const name& owner ) {
+      require_auth( owner );
 
-      if( usecs_since_last_fill > 0 && _gstate.last_pervote_bucket_fill > time_point() ) {
-         auto new_tokens = static_cast<int64_t>( (continuous_rate * double(token_supply.amount) * double(usecs_since_last_fill)) / double(useconds_per_year) );
+      const auto [block_pay, vote_pay] = take_producer_pay( owner );
+      const int64_t pay = block_pay + vote_pay;
+      check( pay > 0, "no rewards to deposit" );
+      send_producer_pay( owner, com_account, block_pay, vote_pay, "deposit producer" );
+      transfer_to_fund( owner, asset( pay, core_symbol() ) );
+   }
 
-         auto to_producers     = new_tokens / inflation_pay_factor;
-         auto to_savings       = new_tokens - to_producers;
-         auto to_per_block_pay = to_producers / votepay_factor;
-         auto to_per_vote_pay  = to_producers - to_per_block_pay;
-         {
-            token::issue_action issue_act{ token_account, { {get_self(), active_permission} } };
-            issue_act.send( get_self(), asset(new_tokens, core_symbol()), "issue tokens for producer pay and savings" );
-         }
-         {
-            token::transfer_action transfer_act{ token_account, { {get_self(), active_permission} } };
-            transfer_act.send( get_self(), saving_account, asset(to_savings, core_symbol()), "unallocated inflation" );
-            transfer_act.send( get_self(), bpay_account, asset(to_per_block_pay, core_symbol()), "fund per-block bucket" );
-            transfer_act.send( get_self(), vpay_account, asset(to_per_vote_pay, core_symbol()), "fund per-vote bucket" );
-         }
+   /**
+    * Takes the rewards of a claim by `owner` out of the pay buckets, along with the pay credited by settlements.
+    * Returns the block pay and the vote pay, which are still held by the pay accounts.
+    */
+   std::pair<int64_t, int64_t> system_contract::take_producer_pay( const name& owner ) {
+      // the blocks of the running round count towards the block pay of this claim
+      auto buffer = _unpaid_blocks.get_or_default();
+      if ( flush_unpaid_blocks( buffer ) )
+         _unpaid_blocks.set( buffer, get_self() );
+      // and so does the vote weight still pending in vote sets
+      flush_pending_vote_sets( vote_set_flushes );
 
-         _gstate.pervote_bucket          += to_per_vote_pay;
-         _gstate.perblock_bucket         += to_per_block_pay;
-         _gstate.last_pervote_bucket_fill = ct;
-      }
+      find_producer( owner );
+      const auto& prod = _producer_stats.get( owner.value );
 
-      auto prod2 = _producers2.find( owner.value );
+      pay_credits_table credits( get_self(), get_self().value );
+      auto credit = credits.find( owner.value );
 
-      /// New metric to be used in pervote pay calculation. Instead of vote weight ratio, we combine vote weight and
-      /// time duration the vote weight has been held into one metric.
-      const auto last_claim_plus_3days = prod.last_claim_time + microseconds(3 * useconds_per_day);
+      const auto ct = current_time_point();
 
-      bool crossed_threshold       = (last_claim_plus_3days <= ct);
-      bool updated_after_threshold = true;
-      if ( prod2 != _producers2.end() ) {
-         updated_after_threshold = (last_claim_plus_3days <= prod2->last_votepay_share_update);
-      } else {
-         prod2 = _producers2.emplace( owner, [&]( producer_info2& info  ) {
-            info.owner                     = owner;
-            info.last_votepay_share_update = ct;
-         });
+      int64_t producer_per_block_pay = 0;
+      int64_t producer_per_vote_pay  = 0;
+      // pay credited by a settlement is withdrawn on its own when there is nothing new to claim
+      if( credit == credits.end() || (prod.active() && ct - prod.last_pay_time > microseconds(useconds_per_day)) ) {
+         check( prod.active(), "producer does not have an active key" );
+         check( gstate().total_activated_stake >= min_activated_stake,
+                       "cannot claim rewards until the chain is activated (at least 15% of all tokens participate in voting)" );
+         check( ct - prod.last_pay_time > microseconds(useconds_per_day), "already claimed rewards within past day" );
+
+         // a settlement within the past day has funded the buckets for the claims until the next one
+         if( ct - payout().last_settlement > microseconds(useconds_per_day) )
+            fill_pay_buckets( ct );
+
+         std::tie( producer_per_block_pay, producer_per_vote_pay ) = credit_producer_pay( prod, ct, true );
+      }
+      if( credit != credits.end() ) {
+         producer_per_block_pay += credit->block_pay;
+         producer_per_vote_pay  += credit->vote_pay;
+         credits.erase( credit );
       }
+      return { producer_per_block_pay, producer_per_vote_pay };
+   }
+
+   /**
+    * Transfers the block pay and the vote pay of `owner` from the pay accounts to `to`, with the memos
+    * "<memo> block pay" and "<memo> vote pay".
+    */
+   void system_contract::send_producer_pay( const name& owner, const name& to, int64_t block_pay, int64_t vote_pay,
+                                            const std::string& memo ) {
+      if ( block_pay > 0 ) {
+         token::transfer_action transfer_act{ token_account, { {bpay_account, active_permission}, {owner, active_permission} } };
+         transfer_act.send( bpay_account, to, asset(block_pay, core_symbol()), memo + " block pay" );
+      }
+      if ( vote_pay > 0 ) {
+         token::transfer_action transfer_act{ token_account, { {vpay_account, active_permission}, {owner, active_permission} } };
+         transfer_act.send( vpay_account, to, asset(vote_pay, core_symbol()), memo + " vote pay" );
+      }
+   }
 
-      // Note: updated_after_threshold implies cross_threshold (except if claiming rewards when the producers2 table row did not exist).
-      // The exception leads to updated_after_threshold to be treated as true regardless of whether the threshold was crossed.
-      // This is okay because in this case the producer will not get paid anything either way.
-      // In fact it is desired behavior because the producers votes need to be counted in the global total_producer_votepay_share for the first time.
+   void system_contract::settlepay( const name& user, uint16_t max ) {
+      require_auth( user );
 
-      int64_t producer_per_block_pay = 0;
-      if( _gstate.total_unpaid_blocks > 0 ) {
-         producer_per_block_pay = (_gstate.perblock_bucket * prod.unpaid_blocks) / _gstate.total_unpaid_blocks;
+      check( max > 0, "max must be positive" );
+      check( !legacy_gstate(), "global state must be merged first" );
+      check( _producers.begin() == _producers.end(), "producers must be migrated first" );
+      check( gstate().total_activated_stake >= min_activated_stake,
+             "cannot settle pay until the chain is activated (at least 15% of all tokens participate in voting)" );
+
+      const auto ct = current_time_point();
+
+      if( !payout().settling ) {
+         check( ct - payout().last_settlement > microseconds(useconds_per_day), "pay has already been settled within past day" );
+
+         auto buffer = _unpaid_blocks.get_or_default();
+         if ( flush_unpaid_blocks( buffer ) )
+            _unpaid_blocks.set( buffer, get_self() );
+         flush_pending_vote_sets( vote_set_flushes );
+
+         fill_pay_buckets( ct );
+         auto& state = mutable_payout();
+         state.last_settlement = ct;
+         state.next_producer   = name();
+         state.settling        = true;
       }
 
-      double new_votepay_share = update_producer_votepay_share( prod2,
-                                    ct,
-                                    updated_after_threshold ? 0.0 : prod.total_votes,
-                                    true // reset votepay_share to zero after updating
-                                 );
-
-      int64_t producer_per_vote_pay = 0;
-      if( _gstate2.revision > 0 ) {
-         double total_votepay_share = update_total_votepay_share( ct );
-         if( total_votepay_share > 0 && !crossed_threshold ) {
-            producer_per_vote_pay = int64_t((new_votepay_share * _gstate.pervote_bucket) / total_votepay_share);
-            if( producer_per_vote_pay > _gstate.pervote_bucket )
-               producer_per_vote_pay = _gstate.pervote_bucket;
-         }
-      } else {
-         if( _gstate.total_producer_vote_weight > 0 ) {
-            producer_per_vote_pay = int64_t((_gstate.pervote_bucket * prod.total_votes) / _gstate.total_producer_vote_weight);
+      pay_credits_table credits( get_self(), get_self().value );
+      auto prod = _producer_stats.lower_bound( payout().next_producer.value );
+      for( uint16_t i = 0; i < max && prod != _producer_stats.end(); ++i, ++prod ) {
+         // producers paid within the past day are paid by their next claim or settlement, and producers that
+         // have not claimed within the vote pay threshold only by their next claim, so that they stop earning
+         // vote pay as they would without settlements
+         if( !prod->active() || (prod->votes() == 0 && prod->unpaid_blocks == 0) ||
+             ct - prod->last_pay_time <= microseconds(useconds_per_day) ||
+             ct - prod->last_claim_time >= microseconds(producer_pay::votepay_threshold) )
+            continue;
+
+         const auto [block_pay, vote_pay] = credit_producer_pay( *prod, ct, false );
+         if( block_pay == 0 && vote_pay == 0 )
+            continue;
+
+         auto credit = credits.find( prod->owner.value );
+         if( credit == credits.end() ) {
+            credits.emplace( get_self(), [&]( auto& c ) {
+               c.owner     = prod->owner;
+               c.block_pay = block_pay;
+               c.vote_pay  = vote_pay;
+            });
+         } else {
+            credits.modify( credit, same_payer, [&]( auto& c ) {
+               c.block_pay += block_pay;
+               c.vote_pay  += vote_pay;
+            });
          }
       }
 
-      if( producer_per_vote_pay < min_pervote_daily_pay ) {
-         producer_per_vote_pay = 0;
-      }
+      auto& state = mutable_payout();
+      state.settling      = prod != _producer_stats.end();
+      state.next_producer = state.settling ? prod->owner : name();
+   }
 
-      _gstate.pervote_bucket      -= producer_per_vote_pay;
-      _gstate.perblock_bucket     -= producer_per_block_pay;
-      _gstate.total_unpaid_blocks -= prod.unpaid_blocks;
+   /**
+    * Issues the inflation since the pay buckets were last filled, with a single issue and one transfer to each
+    * of the savings, per-block and per-vote accounts.
+    */
+   void system_contract::fill_pay_buckets( const time_point& ct ) {
+      auto& gs = mutable_gstate();
+      const asset token_supply   = token::get_supply(token_account, core_symbol().code() );
+      const auto usecs_since_last_fill = (ct - gs.last_pervote_bucket_fill).count();
 
-      update_total_votepay_share( ct, -new_votepay_share, (updated_after_threshold ? prod.total_votes : 0.0) );
+      if( usecs_since_last_fill > 0 && gs.last_pervote_bucket_fill > time_point() ) {
+         const auto issued = producer_pay::inflation( pay_parameters, token_supply.amount, usecs_since_last_fill );
+         {
+            token::issue_action issue_act{ token_account, { {get_self(), active_permission} } };
+            issue_act.send( get_self(), asset(issued.total, core_symbol()), "issue tokens for producer pay and savings" );
+         }
+         {
+            token::transfer_action transfer_act{ token_account, { {get_self(), active_permission} } };
+            transfer_act.send( get_self(), saving_account, asset(issued.to_savings, core_symbol()), "unallocated inflation" );
+            transfer_act.send( get_self(), bpay_account, asset(issued.to_per_block_pay, core_symbol()), "fund per-block bucket" );
+            transfer_act.send( get_self(), vpay_account, asset(issued.to_per_vote_pay, core_symbol()), "fund per-vote bucket" );
+         }
 
-      _producers.modify( prod, same_payer, [&](auto& p) {
-         p.last_claim_time = ct;
-         p.unpaid_blocks   = 0;
+         gs.pervote_bucket          += issued.to_per_vote_pay;
+         gs.perblock_bucket         += issued.to_per_block_pay;
+         gs.last_pervote_bucket_fill = ct;
+      }
+   }
+
+   /**
+    * Takes the block and vote pay of `prod` out of the buckets and resets its unpaid blocks and votepay share,
+    * as a claim at `ct` does. Returns the block pay and the vote pay, the caller transfers or credits them.
+    * Only a `claim` counts as the producer's claim; the vote pay threshold runs from the last one.
+    */
+   std::pair<int64_t, int64_t> system_contract::credit_producer_pay( const producer_stats& prod, const time_point& ct,
+                                                                     bool claim ) {
+      auto& gs = mutable_gstate();
+      producer_pay::buckets b{ gs.perblock_bucket, gs.pervote_bucket, gs.total_unpaid_blocks };
+      auto totals = load_votepay_totals();
+      producer_pay::producer p{ prod.votes(), prod.unpaid_blocks, prod.last_claim_time.time_since_epoch().count(),
+                                { prod.votepay.share(), prod.votepay.last_votepay_share_update.time_since_epoch().count() } };
+
+      // before votepay shares existed the vote pay was split by the producers' votes
+      const bool share_based = gstate2().revision > 0;
+      const auto pay = producer_pay::claim( pay_parameters, b, totals, p, ct.time_since_epoch().count(), share_based,
+                                            share_based ? 0 : vote_totals().producer_vote_weight );
+
+      gs.perblock_bucket     = b.perblock_bucket;
+      gs.pervote_bucket      = b.pervote_bucket;
+      gs.total_unpaid_blocks = b.total_unpaid_blocks;
+      store_votepay_totals( totals );
+
+      _producer_stats.modify( prod, same_payer, [&](auto& row) {
+         if( claim )
+            row.last_claim_time = ct;
+         row.last_pay_time   = ct;
+         row.unpaid_blocks   = 0;
+         row.votepay.set_share( p.votepay.share );
+         row.votepay.last_votepay_share_update = ct;
       });
 
-      if ( producer_per_block_pay > 0 ) {
-         token::transfer_action transfer_act{ token_account, { {bpay_account, active_permission}, {owner, active_permission} } };
-         transfer_act.send( bpay_account, owner, asset(producer_per_block_pay, core_symbol()), "producer block pay" );
-      }
-      if ( producer_per_vote_pay > 0 ) {
-         token::transfer_action transfer_act{ token_account, { {vpay_account, active_permission}, {owner, active_permission} } };
-         transfer_act.send( vpay_account, owner, asset(producer_per_vote_pay, core_symbol()), "producer vote pay" );
-      }
+      return { pay.per_block, pay.per_vote };
    }
 
 } //namespace arisensystem
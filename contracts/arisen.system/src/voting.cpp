@@ -10,7 +10,6 @@
 #include <arisen.token/arisen.token.hpp>
 
 #include <algorithm>
-#include <cmath>
 
 namespace arisensystem {
 
@@ -25,42 +24,48 @@ namespace arisensystem {
       check( producer_key != arisen::public_key(), "public key should not be the default value" );
       require_auth( producer );
 
-      auto prod = _producers.find( producer.value );
+      auto prod = find_producer( producer );
       const auto ct = current_time_point();
 
-      if ( prod != _producers.end() ) {
-         _producers.modify( prod, producer, [&]( producer_info& info ){
+      if ( prod != _producer_stats.end() ) {
+         const bool has_votepay = prod->has_votepay();
+         _producer_stats.modify( prod, producer, [&]( producer_stats& info ){
+            info.is_active = true;
+            if ( info.last_claim_time == time_point() ) {
+               info.last_claim_time = ct;
+               info.last_pay_time   = ct;
+            }
+            if ( !has_votepay )
+               info.votepay.last_votepay_share_update = ct;
+         });
+         _producer_config.modify( _producer_config.get( producer.value ), producer, [&]( producer_config& info ){
             info.producer_key = producer_key;
-            info.is_active    = true;
             info.url          = url;
             info.location     = location;
-            if ( info.last_claim_time == time_point() )
-               info.last_claim_time = ct;
          });
 
-         auto prod2 = _producers2.find( producer.value );
-         if ( prod2 == _producers2.end() ) {
-            _producers2.emplace( producer, [&]( producer_info2& info ){
-               info.owner                     = producer;
-               info.last_votepay_share_update = ct;
-            });
-            update_total_votepay_share( ct, 0.0, prod->total_votes );
-            // When introducing the producer2 table row for the first time, the producer's votes must also be accounted for in the global total_producer_votepay_share at the same time.
+         note_producer_change( prod->votes() );
+         update_producer_ranking( *prod );
+
+         if ( !has_votepay ) {
+            update_total_votepay_share( ct, 0, prod->votes() );
+            // When introducing the votepay accounting for the first time, the producer's votes must also be accounted for in the global total_producer_votepay_share at the same time.
          }
       } else {
-         _producers.emplace( producer, [&]( producer_info& info ){
+         _producer_stats.emplace( producer, [&]( producer_stats& info ){
             info.owner           = producer;
-            info.total_votes     = 0;
-            info.producer_key    = producer_key;
             info.is_active       = true;
-            info.url             = url;
-            info.location        = location;
             info.last_claim_time = ct;
+            info.last_pay_time   = ct;
+            info.votepay.last_votepay_share_update = ct;
          });
-         _producers2.emplace( producer, [&]( producer_info2& info ){
-            info.owner                     = producer;
-            info.last_votepay_share_update = ct;
+         _producer_config.emplace( producer, [&]( producer_config& info ){
+            info.owner        = producer;
+            info.producer_key = producer_key;
+            info.url          = url;
+            info.location     = location;
          });
+         note_producer_change( 0 );
       }
 
    }
@@ -68,30 +73,234 @@ namespace arisensystem {
    void system_contract::unregprod( const name& producer ) {
       require_auth( producer );
 
-      const auto& prod = _producers.get( producer.value, "producer not found" );
-      _producers.modify( prod, same_payer, [&]( producer_info& info ){
-         info.deactivate();
+      auto prod = find_producer( producer );
+      check( prod != _producer_stats.end(), "producer not found" );
+      deactivate_producer( prod );
+   }
+
+   /**
+    *  Returns the producer's `prodstats` row, moving the producer over from the `producers` and
+    *  `producers2` tables first if `migrateprods` has not reached it yet. Returns the end iterator
+    *  for accounts that never registered as producers.
+    */
+   producer_stats_table::const_iterator system_contract::find_producer( const name& producer ) {
+      auto prod = _producer_stats.find( producer.value );
+      if ( prod != _producer_stats.end() )
+         return prod;
+      auto legacy = _producers.find( producer.value );
+      if ( legacy == _producers.end() )
+         return prod;
+      return migrate_producer( legacy );
+   }
+
+   producer_stats_table::const_iterator system_contract::migrate_producer( const producers_table::const_iterator& legacy ) {
+      const name owner   = legacy->owner;
+      const auto votepay = legacy_votepay( *legacy );
+      // the rows keep the producer as RAM payer, who paid for the rows they replace
+      auto prod = _producer_stats.emplace( owner, [&]( producer_stats& info ){
+         info.owner           = owner;
+         info.set_votes( legacy->votes() );
+         info.is_active       = legacy->is_active;
+         info.unpaid_blocks   = legacy->unpaid_blocks;
+         info.last_claim_time = legacy->last_claim_time;
+         info.last_pay_time   = legacy->last_claim_time;
+         if ( votepay )
+            info.votepay = *votepay;
+      });
+      _producer_config.emplace( owner, [&]( producer_config& info ){
+         info.owner        = owner;
+         info.producer_key = legacy->producer_key;
+         info.url          = legacy->url;
+         info.location     = legacy->location;
+      });
+
+      auto prod2 = _producers2.find( owner.value );
+      if ( prod2 != _producers2.end() )
+         _producers2.erase( prod2 );
+      _producers.erase( legacy );
+      return prod;
+   }
+
+   void system_contract::deactivate_producer( const producer_stats_table::const_iterator& prod ) {
+      note_producer_change( prod->votes() );
+      _producer_stats.modify( prod, same_payer, [&]( producer_stats& info ){
+         info.is_active = false;
       });
+      update_producer_ranking( *prod );
+      _producer_config.modify( _producer_config.get( prod->owner.value ), same_payer, [&]( producer_config& info ){
+         info.producer_key = arisen::public_key();
+      });
+   }
+
+   void system_contract::migrateprods( uint32_t max_rows ) {
+      require_auth( get_self() );
+
+      check( max_rows > 0, "max_rows must be positive" );
+      check( _producers.begin() != _producers.end(), "producers have already been migrated" );
+
+      for ( uint32_t i = 0; i < max_rows && _producers.begin() != _producers.end(); ++i ) {
+         migrate_producer( _producers.begin() );
+      }
+   }
+
+   /**
+    *  Records that a producer with `votes`, before or after the change, changed its votes, key or
+    *  activity. Producers below the last of the 21 elected producers cannot enter the schedule that
+    *  way while the elected ones keep their votes, so their changes do not require a new election.
+    */
+   void system_contract::note_producer_change( int128_t votes ) {
+      const auto& el = election();
+      if ( !el.ranking_changed && votes >= el.min_elected_votes ) {
+         mutable_election().ranking_changed = true;
+      }
+   }
+
+   const producer_ranking& system_contract::ranking() {
+      if ( !_ranking ) {
+         _ranking = _producer_ranking.get_or_default();
+      }
+      return *_ranking;
+   }
+
+   producer_ranking& system_contract::mutable_ranking() {
+      ranking();
+      _ranking_dirty = true;
+      return *_ranking;
+   }
+
+   /**
+    *  Moves `prod` into or out of the ranking after a change of its votes or activity. Producers that
+    *  stay on their side of `outside_votes` leave the ranking untouched; a producer that enters a full
+    *  ranking pushes out the ranked producer with the fewest votes, which are only read then. A ranked
+    *  producer that falls below the boundary is dropped, and the producers it could have been replaced
+    *  with are only known to the producer tables, so the ranking becomes stale once too few producers
+    *  are left to fill a schedule.
+    */
+   void system_contract::update_producer_ranking( const producer_stats& prod ) {
+      const auto& r = ranking();
+      if ( r.stale ) {
+         return; // the next election rebuilds the ranking
+      }
+
+      const auto pos    = std::lower_bound( r.producers.cbegin(), r.producers.cend(), prod.owner );
+      const bool ranked = pos != r.producers.cend() && *pos == prod.owner;
+      const bool above  = prod.eligible() && prod.votes() >= r.outside_votes;
+      if ( ranked == above ) {
+         return; // stays on its side of the boundary
+      }
+
+      auto& mr = mutable_ranking();
+      if ( ranked ) {
+         mr.producers.erase( mr.producers.begin() + ( pos - r.producers.cbegin() ) );
+         if ( mr.producers.size() < 21 && mr.outside_votes > 0 ) {
+            mr.stale = true;
+         }
+         return;
+      }
+
+      mr.producers.insert( mr.producers.begin() + ( pos - r.producers.cbegin() ), prod.owner );
+      if ( mr.producers.size() > max_ranked_producers ) {
+         const auto last = ranked_candidates().back();
+         mr.outside_votes = last.votes;
+         mr.producers.erase( std::lower_bound( mr.producers.begin(), mr.producers.end(), last.owner ) );
+      }
+   }
+
+   /**
+    *  Ranked producers with their current votes, in election order. Producers that have not been
+    *  moved to `prodstats` yet are read from the legacy table.
+    */
+   std::vector<ranked_producer> system_contract::ranked_candidates() {
+      std::vector<ranked_producer> candidates;
+      candidates.reserve( ranking().producers.size() );
+      for ( const auto& owner : ranking().producers ) {
+         auto prod = _producer_stats.find( owner.value );
+         if ( prod != _producer_stats.end() ) {
+            candidates.push_back( ranked_producer{ owner, prod->votes() } );
+         } else {
+            candidates.push_back( ranked_producer{ owner, _producers.get( owner.value, "ranked producer not found" ).votes() } );
+         }
+      }
+      std::sort( candidates.begin(), candidates.end() );
+      return candidates;
+   }
+
+   /**
+    *  Ranks the active producers with votes from the producer tables. Producers that have been moved
+    *  to `prodstats` are scanned, of the ones still in `producers` only the top of its vote index.
+    */
+   void system_contract::rebuild_producer_ranking() {
+      std::vector<ranked_producer> candidates;
+      for ( const auto& prod : _producer_stats ) {
+         if ( prod.eligible() )
+            candidates.push_back( ranked_producer{ prod.owner, prod.votes() } );
+      }
+      auto legacy = _producers.get_index<"prototalvote"_n>();
+      uint32_t legacy_count = 0;
+      for ( auto it = legacy.cbegin(); it != legacy.cend() && legacy_count <= max_ranked_producers; ++it, ++legacy_count ) {
+         if ( !( 0 < it->total_votes && it->active() ) )
+            break;
+         candidates.push_back( ranked_producer{ it->owner, it->votes() } );
+      }
+      std::sort( candidates.begin(), candidates.end() );
+
+      auto& r = mutable_ranking();
+      r.outside_votes = candidates.size() > max_ranked_producers ? candidates[max_ranked_producers].votes : 0;
+      if ( candidates.size() > max_ranked_producers )
+         candidates.resize( max_ranked_producers );
+      r.producers.clear();
+      for ( const auto& c : candidates )
+         r.producers.push_back( c.owner );
+      std::sort( r.producers.begin(), r.producers.end() );
+      r.stale = false;
    }
 
    void system_contract::update_elected_producers( const block_timestamp& block_time ) {
-      _gstate.last_producer_schedule_update = block_time;
+      mutable_gstate().last_producer_schedule_update = block_time;
+
+      // weight pending on proxies and vote sets may change the ranking
+      flush_pending_proxies( proxy_flushes_per_election );
+      flush_pending_vote_sets( vote_set_flushes );
+
+      // nothing that can change the elected producers happened since the last election
+      if ( !election().ranking_changed ) {
+         return;
+      }
 
-      auto idx = _producers.get_index<"prototalvote"_n>();
+      if ( ranking().stale ) {
+         rebuild_producer_ranking();
+      }
+      const auto ranked = ranked_candidates();
 
       std::vector< std::pair<arisen::producer_key,uint16_t> > top_producers;
       top_producers.reserve(21);
 
-      for ( auto it = idx.cbegin(); it != idx.cend() && top_producers.size() < 21 && 0 < it->total_votes && it->active(); ++it ) {
-         top_producers.emplace_back( std::pair<arisen::producer_key,uint16_t>({{it->owner, it->producer_key}, it->location}) );
+      // producers not migrated yet are still registered in the legacy table
+      for ( const auto& candidate : ranked ) {
+         if ( top_producers.size() == 21 )
+            break;
+         auto config = _producer_config.find( candidate.owner.value );
+         if ( config != _producer_config.end() ) {
+            top_producers.emplace_back( std::pair<arisen::producer_key,uint16_t>({{candidate.owner, config->producer_key}, config->location}) );
+         } else {
+            const auto& prod = _producers.get( candidate.owner.value, "ranked producer not found" );
+            top_producers.emplace_back( std::pair<arisen::producer_key,uint16_t>({{candidate.owner, prod.producer_key}, prod.location}) );
+         }
       }
 
-      if ( top_producers.size() == 0 || top_producers.size() < _gstate.last_producer_schedule_size ) {
+      auto& el = mutable_election();
+      el.ranking_changed   = false;
+      el.min_elected_votes = top_producers.size() == 21 ? ranked[20].votes : 0;
+
+      if ( top_producers.size() == 0 || top_producers.size() < gstate().last_producer_schedule_size ) {
          return;
       }
 
-      /// sort by producer name
+      /// sort by producer name, then arrange in the configured schedule order
       std::sort( top_producers.begin(), top_producers.end() );
+      producer_schedule::arrange( top_producers.begin(), top_producers.end(),
+                                  producer_schedule::order( schedule_params().order ),
+                                  []( const auto& p ) { return p.second; } );
 
       std::vector<arisen::producer_key> producers;
 
@@ -99,70 +308,125 @@ namespace arisensystem {
       for( const auto& item : top_producers )
          producers.push_back(item.first);
 
+      // proposing the schedule that was proposed last time would have no effect
+      const auto packed = arisen::pack( producers );
+      const auto digest = arisen::sha256( packed.data(), packed.size() );
+      if( digest == el.schedule_digest ) {
+         return;
+      }
+
       if( set_proposed_producers( producers ) >= 0 ) {
-         _gstate.last_producer_schedule_size = static_cast<decltype(_gstate.last_producer_schedule_size)>( top_producers.size() );
+         auto& gs = mutable_gstate();
+         gs.last_producer_schedule_size = static_cast<decltype(gs.last_producer_schedule_size)>( top_producers.size() );
+         el.schedule_digest = digest;
       }
    }
 
-   double stake2vote( int64_t staked ) {
-      /// TODO subtract 2080 brings the large numbers closer to this decade
-      double weight = int64_t( (current_time_point().sec_since_epoch() - (block_timestamp::block_timestamp_epoch / 1000)) / (seconds_per_day * 7) )  / double( 52 );
-      return double(staked) * std::pow( 2, weight );
+   /**
+    *  The multiplier only changes once a week and the block time is fixed for the whole action, so it is
+    *  derived on the first conversion of an action and every later one is a multiply and a shift. Each
+    *  action starts from a fresh contract memory, which drops the cached value.
+    */
+   int128_t stake2vote( int64_t staked ) {
+      static const vote_weight::multiplier multiplier = [] {
+         const uint32_t weeks = (current_time_point().sec_since_epoch() - (block_timestamp::block_timestamp_epoch / 1000)) / (seconds_per_day * 7);
+         return vote_weight::weekly( weeks );
+      }();
+      return vote_weight::stake_to_weight( staked, multiplier );
    }
 
-   double system_contract::update_total_votepay_share( const time_point& ct,
-                                                       double additional_shares_delta,
-                                                       double shares_rate_delta )
-   {
-      double delta_total_votepay_share = 0.0;
-      if( ct > _gstate3.last_vpay_state_update ) {
-         delta_total_votepay_share = _gstate3.total_vpay_share_change_rate
-                                       * double( (ct - _gstate3.last_vpay_state_update).count() / 1E6 );
-      }
+   void system_contract::update_total_vote_weight( int128_t delta ) {
+      vote_totals();
+      _vote_totals->producer_vote_weight += delta;
+      mutable_gstate().total_producer_vote_weight = vote_weight::to_double( _vote_totals->producer_vote_weight );
+   }
 
-      delta_total_votepay_share += additional_shares_delta;
-      if( delta_total_votepay_share < 0 && _gstate2.total_producer_votepay_share < -delta_total_votepay_share ) {
-         _gstate2.total_producer_votepay_share = 0.0;
-      } else {
-         _gstate2.total_producer_votepay_share += delta_total_votepay_share;
-      }
+   int128_t system_contract::update_total_votepay_share( const time_point& ct,
+                                                         int128_t additional_shares_delta,
+                                                         int128_t shares_rate_delta )
+   {
+      auto totals = load_votepay_totals();
+      producer_pay::update_total_votepay_share( totals, ct.time_since_epoch().count(), additional_shares_delta, shares_rate_delta );
+      store_votepay_totals( totals );
+      return totals.share;
+   }
 
-      if( shares_rate_delta < 0 && _gstate3.total_vpay_share_change_rate < -shares_rate_delta ) {
-         _gstate3.total_vpay_share_change_rate = 0.0;
-      } else {
-         _gstate3.total_vpay_share_change_rate += shares_rate_delta;
-      }
+   producer_pay::votepay_totals system_contract::load_votepay_totals() {
+      const auto& totals = vote_totals();
+      return { totals.producer_votepay_share, totals.vpay_share_change_rate,
+               gstate3().last_vpay_state_update.time_since_epoch().count() };
+   }
 
-      _gstate3.last_vpay_state_update = ct;
+   /**
+    *  Stores the votepay totals along with the double precision fields kept for table readers.
+    */
+   void system_contract::store_votepay_totals( const producer_pay::votepay_totals& totals ) {
+      vote_totals();
+      _vote_totals->producer_votepay_share = totals.share;
+      _vote_totals->vpay_share_change_rate = totals.change_rate;
 
-      return _gstate2.total_producer_votepay_share;
+      auto& gs3 = mutable_gstate3();
+      mutable_gstate2().total_producer_votepay_share = vote_weight::share_to_double( totals.share );
+      gs3.total_vpay_share_change_rate               = vote_weight::to_double( totals.change_rate );
+      gs3.last_vpay_state_update                     = time_point( microseconds( totals.last_update ) );
    }
 
-   double system_contract::update_producer_votepay_share( const producers_table2::const_iterator& prod_itr,
-                                                          const time_point& ct,
-                                                          double shares_rate,
-                                                          bool reset_to_zero )
-   {
-      double delta_votepay_share = 0.0;
-      if( shares_rate > 0.0 && ct > prod_itr->last_votepay_share_update ) {
-         delta_votepay_share = shares_rate * double( (ct - prod_itr->last_votepay_share_update).count() / 1E6 ); // cannot be negative
+   /**
+    *  Returns the votepay accounting of a producer that has not been migrated yet, taken from the
+    *  `producer_info2` row unless it has been moved into the `producer_info` row. Producers registered
+    *  before votepay have neither.
+    */
+   std::optional<producer_votepay> system_contract::legacy_votepay( const producer_info& prod ) {
+      if( prod.votepay.has_value() ) {
+         return prod.votepay.value();
       }
+      auto prod2 = _producers2.find( prod.owner.value );
+      if( prod2 == _producers2.end() ) {
+         return {};
+      }
+      producer_votepay votepay;
+      votepay.set_share( prod2->share() );
+      votepay.last_votepay_share_update = prod2->last_votepay_share_update;
+      return votepay;
+   }
 
-      double new_votepay_share = prod_itr->votepay_share + delta_votepay_share;
-      _producers2.modify( prod_itr, same_payer, [&](auto& p) {
-         if( reset_to_zero )
-            p.votepay_share = 0.0;
-         else
-            p.votepay_share = new_votepay_share;
-
-         p.last_votepay_share_update = ct;
-      } );
+   /**
+    *  Settles the votepay shares accrued since the last update into `votepay`, the caller stores it
+    *  together with its other changes to the producer row.
+    */
+   int128_t system_contract::update_producer_votepay_share( producer_votepay& votepay,
+                                                            const time_point& ct,
+                                                            int128_t shares_rate,
+                                                            bool reset_to_zero )
+   {
+      producer_pay::votepay_account account{ votepay.share(), votepay.last_votepay_share_update.time_since_epoch().count() };
+      const int128_t new_votepay_share = producer_pay::update_producer_votepay_share( account, ct.time_since_epoch().count(),
+                                                                                       shares_rate, reset_to_zero );
+      votepay.set_share( account.share );
+      votepay.last_votepay_share_update = ct;
 
       return new_votepay_share;
    }
 
    void system_contract::voteproducer( const name& voter_name, const name& proxy, const std::vector<name>& producers ) {
       require_auth( voter_name );
+      cast_vote( voter_name, proxy, producers );
+   }
+
+   void system_contract::bulkvote( const std::vector<producer_vote>& votes ) {
+      check( !votes.empty(), "no votes specified" );
+
+      // each producer touched by the batch is written once, after the last vote
+      _defer_vote_deltas = true;
+      for( const auto& v : votes ) {
+         require_auth( v.voter );
+         cast_vote( v.voter, v.proxy, v.producers );
+      }
+      _defer_vote_deltas = false;
+      flush_vote_deltas();
+   }
+
+   void system_contract::cast_vote( const name& voter_name, const name& proxy, const std::vector<name>& producers ) {
       vote_stake_updater( voter_name );
       update_votes( voter_name, proxy, producers, true );
       auto com_itr = _combalance.find( voter_name.value );
@@ -183,195 +447,584 @@ namespace arisensystem {
          }
       }
 
-      auto voter = _voters.find( voter_name.value );
+      auto voter = find_voter( voter_name );
       check( voter != _voters.end(), "user must stake before they can vote" ); /// staking creates voter object
-      check( !proxy || !voter->is_proxy, "account registered as a proxy is not allowed to use a proxy" );
+      check( !proxy || !voter->is_proxy(), "account registered as a proxy is not allowed to use a proxy" );
 
       /**
        * The first time someone votes we calculate and set last_vote_weight, since they cannot unstake until
        * after total_activated_stake hits threshold, we can use last_vote_weight to determine that this is
        * their first vote and should consider their stake activated.
        */
-      if( voter->last_vote_weight <= 0.0 ) {
-         _gstate.total_activated_stake += voter->staked;
-         if( _gstate.total_activated_stake >= min_activated_stake && _gstate.thresh_activated_stake_time == time_point() ) {
-            _gstate.thresh_activated_stake_time = current_time_point();
+      if( voter->weight() <= 0 ) {
+         auto& gs = mutable_gstate();
+         gs.total_activated_stake += voter->staked;
+         if( gs.total_activated_stake >= min_activated_stake && gs.thresh_activated_stake_time == time_point() ) {
+            gs.thresh_activated_stake_time = current_time_point();
          }
       }
 
-      auto new_vote_weight = stake2vote( voter->staked );
-      if( voter->is_proxy ) {
-         new_vote_weight += voter->proxied_vote_weight;
+      int128_t new_vote_weight = stake2vote( voter->staked );
+      if( voter->is_proxy() ) {
+         new_vote_weight += voter->proxied_weight();
       }
 
-      std::map<name, std::pair<double, bool /*new*/> > producer_deltas;
-      if ( voter->last_vote_weight > 0 ) {
-         if( voter->proxy ) {
-            auto old_proxy = _voters.find( voter->proxy.value );
+      static const std::vector<name> no_producers;
+      const int128_t last_vote_weight = voter->weight();
+
+      // the producers of the old and the new vote are written once, after both are applied
+      const bool defer_vote_deltas = _defer_vote_deltas;
+      _defer_vote_deltas = true;
+
+      if ( !voting && proxy && last_vote_weight > 0 && voter->proxy == proxy ) {
+         // a stake change only moves the weight delegated to the same proxy, which may cast it later
+         auto& same_proxy = get_voter( proxy, "old proxy not found" ); //data corruption
+         update_proxied_weight( same_proxy, new_vote_weight - last_vote_weight, true, voter_name );
+      } else {
+         if ( last_vote_weight > 0 && voter->proxy ) {
+            auto old_proxy = find_voter( voter->proxy );
             check( old_proxy != _voters.end(), "old proxy not found" ); //data corruption
-            _voters.modify( old_proxy, same_payer, [&]( auto& vp ) {
-                  vp.proxied_vote_weight -= voter->last_vote_weight;
-               });
-            propagate_weight_change( *old_proxy );
-         } else {
-            for( const auto& p : voter->producers ) {
-               auto& d = producer_deltas[p];
-               d.first -= voter->last_vote_weight;
-               d.second = false;
+            update_proxied_weight( *old_proxy, -last_vote_weight, false );
+         }
+
+         if( proxy ) {
+            auto new_proxy = find_voter( proxy );
+            check( new_proxy != _voters.end(), "invalid proxy specified" ); //if ( !voting ) { data corruption } else { wrong vote }
+            check( !voting || new_proxy->is_proxy(), "proxy not found" );
+            if ( new_vote_weight >= 0 ) {
+               update_proxied_weight( *new_proxy, new_vote_weight, false );
             }
          }
       }
 
-      if( proxy ) {
-         auto new_proxy = _voters.find( proxy.value );
-         check( new_proxy != _voters.end(), "invalid proxy specified" ); //if ( !voting ) { data corruption } else { wrong vote }
-         check( !voting || new_proxy->is_proxy, "proxy not found" );
-         if ( new_vote_weight >= 0 ) {
-            _voters.modify( new_proxy, same_payer, [&]( auto& vp ) {
-                  vp.proxied_vote_weight += new_vote_weight;
-               });
-            propagate_weight_change( *new_proxy );
-         }
-      } else {
-         if( new_vote_weight >= 0 ) {
-            for( const auto& p : producers ) {
-               auto& d = producer_deltas[p];
-               d.first += new_vote_weight;
-               d.second = true;
+      /**
+       * Votes for producers go through vote sets. A stake change of a voter only changes the weight of
+       * its set, which casts it when it reaches the thresholds of `vote_debounce_parameters`. Otherwise
+       * the voter's weight is moved between the producers right away, as is the weight cast by the sets.
+       */
+      const uint64_t old_set = voter->vote_set();
+      const bool     joins   = !proxy && !producers.empty() && new_vote_weight >= 0;
+      uint64_t       new_set = 0;
+      if ( !voting && old_set && joins ) {
+         const auto& set = _vote_sets.get( old_set, "vote set not found" ); //data corruption
+         // a voter of the set takes the row over once its payer has left
+         _vote_sets.modify( set, set.payer ? same_payer : voter_name, [&]( auto& s ) {
+               s.weight += new_vote_weight - last_vote_weight;
+               if ( !s.payer )
+                  s.payer = voter_name;
             }
+         );
+         settle_vote_set( set, false, voter_name );
+         new_set = old_set;
+      } else {
+         apply_vote_deltas( ( last_vote_weight > 0 && !voter->proxy ) ? voted_producers( *voter ) : no_producers, last_vote_weight,
+                            joins ? producers : no_producers, new_vote_weight,
+                            voting );
+         if ( old_set ) {
+            _vote_sets.modify( _vote_sets.get( old_set, "vote set not found" ), same_payer, [&]( auto& s ) { //data corruption
+                  s.weight      -= last_vote_weight;
+                  s.cast_weight -= last_vote_weight;
+                  --s.voters;
+                  if ( s.payer == voter_name )
+                     s.payer = name(); // still billed to the voter until another voter of the set takes it over
+               }
+            );
+         }
+         if ( joins ) {
+            const auto& set = intern_vote_set( producers, voter_name );
+            _vote_sets.modify( set, set.payer ? same_payer : voter_name, [&]( auto& s ) {
+                  s.weight      += new_vote_weight;
+                  s.cast_weight += new_vote_weight;
+                  ++s.voters;
+                  if ( !s.payer )
+                     s.payer = voter_name;
+               }
+            );
+            new_set = set.id;
+         }
+         if ( old_set && old_set != new_set ) {
+            // the weight left pending by the voter's stake changes is cast with the rest of the vote
+            settle_vote_set( _vote_sets.get( old_set ), true );
          }
       }
 
-      const auto ct = current_time_point();
-      double delta_change_rate         = 0.0;
-      double total_inactive_vpay_share = 0.0;
-      for( const auto& pd : producer_deltas ) {
-         auto pitr = _producers.find( pd.first.value );
-         if( pitr != _producers.end() ) {
-            if( voting && !pitr->active() && pd.second.second /* from new set */ ) {
-               check( false, ( "producer " + pitr->owner.to_string() + " is not currently registered" ).data() );
+      _defer_vote_deltas = defer_vote_deltas;
+      if ( !_defer_vote_deltas ) {
+         flush_vote_deltas();
+      }
+
+      // the whole stake is cast now, and so is the whole proxied weight
+      clear_pending_changes( *voter );
+      _voters.modify( voter, same_payer, [&]( auto& av ) {
+         av.set_weights( new_vote_weight, av.proxied_weight() );
+         av.proxy = proxy;
+         av.set_vote_set( new_set );
+      });
+   }
+
+   /**
+    *  Both producer lists are sorted, so a single merge pass yields the net change of each producer
+    *  the vote is withdrawn from or cast for. Producers whose total does not change are not modified,
+    *  although, when voting, the ones in the new list are still required to be registered and active.
+    *  Changes are collected in `_vote_deltas` and written right away, unless a `bulkvote` is in progress.
+    */
+   void system_contract::apply_vote_deltas( const std::vector<name>& old_producers, int128_t old_weight,
+                                            const std::vector<name>& new_producers, int128_t new_weight,
+                                            bool voting )
+   {
+      auto old_itr = old_producers.begin();
+      auto new_itr = new_producers.begin();
+      while( old_itr != old_producers.end() || new_itr != new_producers.end() ) {
+         name     producer;
+         int128_t delta    = 0;
+         bool     from_new = false;
+         if( new_itr == new_producers.end() || ( old_itr != old_producers.end() && *old_itr < *new_itr ) ) {
+            producer = *old_itr++;
+            delta    = -old_weight;
+         } else {
+            producer = *new_itr++;
+            delta    = new_weight;
+            from_new = true;
+            if( old_itr != old_producers.end() && *old_itr == producer ) {
+               delta -= old_weight;
+               ++old_itr;
             }
-            double init_total_votes = pitr->total_votes;
-            _producers.modify( pitr, same_payer, [&]( auto& p ) {
-               p.total_votes += pd.second.first;
-               if ( p.total_votes < 0 ) { // floating point arithmetics can give small negative numbers
-                  p.total_votes = 0;
-               }
-               _gstate.total_producer_vote_weight += pd.second.first;
-               //check( p.total_votes >= 0, "something bad happened" );
-            });
-            auto prod2 = _producers2.find( pd.first.value );
-            if( prod2 != _producers2.end() ) {
-               const auto last_claim_plus_3days = pitr->last_claim_time + microseconds(3 * useconds_per_day);
-               bool crossed_threshold       = (last_claim_plus_3days <= ct);
-               bool updated_after_threshold = (last_claim_plus_3days <= prod2->last_votepay_share_update);
-               // Note: updated_after_threshold implies cross_threshold
-
-               double new_votepay_share = update_producer_votepay_share( prod2,
-                                             ct,
-                                             updated_after_threshold ? 0.0 : init_total_votes,
-                                             crossed_threshold && !updated_after_threshold // only reset votepay_share once after threshold
-                                          );
-
-               if( !crossed_threshold ) {
-                  delta_change_rate += pd.second.first;
-               } else if( !updated_after_threshold ) {
-                  total_inactive_vpay_share += new_votepay_share;
-                  delta_change_rate -= init_total_votes;
+         }
+
+         // producers are never erased, so only votes just cast need to be looked up when nothing changes
+         if( delta == 0 && !( voting && from_new ) ) {
+            continue;
+         }
+
+         auto pending = _vote_deltas.find( producer );
+         const producer_stats* prod = nullptr;
+         if( pending != _vote_deltas.end() ) {
+            prod = pending->second.first;
+         } else {
+            auto pitr = find_producer( producer );
+            if( pitr == _producer_stats.end() ) {
+               if( from_new ) {
+                  check( false, ( "producer " + producer.to_string() + " is not registered" ).data() );
                }
+               continue;
             }
+            prod = &*pitr;
+         }
+         if( voting && !prod->active() && from_new ) {
+            check( false, ( "producer " + prod->owner.to_string() + " is not currently registered" ).data() );
+         }
+         if( delta == 0 ) {
+            continue;
+         }
+
+         if( pending != _vote_deltas.end() ) {
+            pending->second.second += delta;
          } else {
-            if( pd.second.second ) {
-               check( false, ( "producer " + pd.first.to_string() + " is not registered" ).data() );
+            _vote_deltas.emplace( producer, std::make_pair( prod, delta ) );
+         }
+      }
+
+      if( !_defer_vote_deltas ) {
+         flush_vote_deltas();
+      }
+   }
+
+   /**
+    *  Writes the collected producer vote changes. A producer touched by several votes of a batch is
+    *  modified once with the sum of their changes, which leaves the same state as applying them one
+    *  by one at the same time: only the first update of a producer accrues votepay shares or crosses
+    *  the claim threshold, later ones at the same time point have nothing left to do. A producer whose
+    *  changes cancel out is still updated, as it would have been by the individual votes.
+    *
+    *  The votepay accounting lives in the producer row, so a vote writes one row per producer; the
+    *  global total accrues lazily from its change rate and never needs the producers to be visited.
+    */
+   void system_contract::flush_vote_deltas() {
+      if( _vote_deltas.empty() ) {
+         return;
+      }
+
+      const auto ct = current_time_point();
+      int128_t delta_change_rate         = 0;
+      int128_t total_inactive_vpay_share = 0;
+      int128_t total_delta               = 0;
+      for( const auto& pd : _vote_deltas ) {
+         const auto& prod  = *pd.second.first;
+         const auto  delta = pd.second.second;
+
+         const int128_t init_total_votes = prod.votes();
+         auto votepay = prod.votepay;
+         if( prod.has_votepay() ) {
+            const auto last_claim_plus_3days = prod.last_claim_time + microseconds(3 * useconds_per_day);
+            bool crossed_threshold       = (last_claim_plus_3days <= ct);
+            bool updated_after_threshold = (last_claim_plus_3days <= votepay.last_votepay_share_update);
+            // Note: updated_after_threshold implies cross_threshold
+
+            int128_t new_votepay_share = update_producer_votepay_share( votepay,
+                                            ct,
+                                            updated_after_threshold ? 0 : init_total_votes,
+                                            crossed_threshold && !updated_after_threshold // only reset votepay_share once after threshold
+                                         );
+
+            if( !crossed_threshold ) {
+               delta_change_rate += delta;
+            } else if( !updated_after_threshold ) {
+               total_inactive_vpay_share += new_votepay_share;
+               delta_change_rate -= init_total_votes;
             }
          }
+
+         _producer_stats.modify( prod, same_payer, [&]( auto& p ) {
+            // exact arithmetic cannot go below zero, only totals converted from the former
+            // double precision field can carry rounding that the voters' weights do not
+            p.set_votes( std::max<int128_t>( init_total_votes + delta, 0 ) );
+            p.votepay = votepay;
+         });
+         note_producer_change( std::max( init_total_votes, prod.votes() ) );
+         update_producer_ranking( prod );
+         total_delta += delta;
       }
+      _vote_deltas.clear();
 
+      update_total_vote_weight( total_delta );
       update_total_votepay_share( ct, -total_inactive_vpay_share, delta_change_rate );
-
-      _voters.modify( voter, same_payer, [&]( auto& av ) {
-         av.last_vote_weight = new_vote_weight;
-         av.producers = producers;
-         av.proxy     = proxy;
-      });
    }
 
    void system_contract::regproxy( const name& proxy, bool isproxy ) {
       require_auth( proxy );
 
-      auto pitr = _voters.find( proxy.value );
+      auto pitr = find_voter( proxy );
       if ( pitr != _voters.end() ) {
-         check( isproxy != pitr->is_proxy, "action has no effect" );
+         check( isproxy != pitr->is_proxy(), "action has no effect" );
          check( !isproxy || !pitr->proxy, "account that uses a proxy is not allowed to become a proxy" );
          _voters.modify( pitr, same_payer, [&]( auto& p ) {
-               p.is_proxy = isproxy;
+               p.flags = set_field( p.flags, voter_info2::flags_fields::is_proxy, isproxy );
             });
          propagate_weight_change( *pitr );
       } else {
          _voters.emplace( proxy, [&]( auto& p ) {
                p.owner  = proxy;
-               p.is_proxy = isproxy;
+               p.flags  = set_field( p.flags, voter_info2::flags_fields::is_proxy, isproxy );
             });
       }
    }
 
-   void system_contract::propagate_weight_change( const voter_info& voter ) {
-      check( !voter.proxy || !voter.is_proxy, "account registered as a proxy is not allowed to use a proxy" );
-      double new_weight = stake2vote( voter.staked );
-      if ( voter.is_proxy ) {
-         new_weight += voter.proxied_vote_weight;
+   void system_contract::propagate_weight_change( const voter_info2& voter ) {
+      check( !voter.proxy || !voter.is_proxy(), "account registered as a proxy is not allowed to use a proxy" );
+      int128_t new_weight = stake2vote( voter.staked );
+      if ( voter.is_proxy() ) {
+         new_weight += voter.proxied_weight();
       }
 
-      /// don't propagate small changes (1 ~= epsilon)
-      if ( fabs( new_weight - voter.last_vote_weight ) > 1 )  {
+      /// vote weights are exact, every change is propagated and nothing is left to propagate otherwise
+      const int128_t delta = new_weight - voter.weight();
+      if ( delta == 0 && pending_proxied_of( voter ) == 0 ) {
+         return;
+      }
+
+      if ( delta != 0 ) {
          if ( voter.proxy ) {
-            auto& proxy = _voters.get( voter.proxy.value, "proxy not found" ); //data corruption
-            _voters.modify( proxy, same_payer, [&]( auto& p ) {
-                  p.proxied_vote_weight += new_weight - voter.last_vote_weight;
-               }
-            );
-            propagate_weight_change( proxy );
+            update_proxied_weight( get_voter( voter.proxy, "proxy not found" ), delta, false ); //data corruption
          } else {
-            auto delta = new_weight - voter.last_vote_weight;
-            const auto ct = current_time_point();
-            double delta_change_rate         = 0;
-            double total_inactive_vpay_share = 0;
-            for ( auto acnt : voter.producers ) {
-               auto& prod = _producers.get( acnt.value, "producer not found" ); //data corruption
-               const double init_total_votes = prod.total_votes;
-               _producers.modify( prod, same_payer, [&]( auto& p ) {
-                  p.total_votes += delta;
-                  _gstate.total_producer_vote_weight += delta;
-               });
-               auto prod2 = _producers2.find( acnt.value );
-               if ( prod2 != _producers2.end() ) {
-                  const auto last_claim_plus_3days = prod.last_claim_time + microseconds(3 * useconds_per_day);
-                  bool crossed_threshold       = (last_claim_plus_3days <= ct);
-                  bool updated_after_threshold = (last_claim_plus_3days <= prod2->last_votepay_share_update);
-                  // Note: updated_after_threshold implies cross_threshold
-
-                  double new_votepay_share = update_producer_votepay_share( prod2,
-                                                ct,
-                                                updated_after_threshold ? 0.0 : init_total_votes,
-                                                crossed_threshold && !updated_after_threshold // only reset votepay_share once after threshold
-                                             );
-
-                  if( !crossed_threshold ) {
-                     delta_change_rate += delta;
-                  } else if( !updated_after_threshold ) {
-                     total_inactive_vpay_share += new_votepay_share;
-                     delta_change_rate -= init_total_votes;
+            const auto& producers = voted_producers( voter );
+            apply_vote_deltas( producers, voter.weight(), producers, new_weight, false );
+            if ( voter.vote_set() ) {
+               _vote_sets.modify( _vote_sets.get( voter.vote_set() ), same_payer, [&]( auto& s ) {
+                     s.weight      += delta;
+                     s.cast_weight += delta;
                   }
-               }
+               );
             }
-
-            update_total_votepay_share( ct, -total_inactive_vpay_share, delta_change_rate );
          }
       }
+      clear_pending_changes( voter );
       _voters.modify( voter, same_payer, [&]( auto& v ) {
-            v.last_vote_weight = new_weight;
+            v.set_weights( new_weight, v.proxied_weight() );
          }
       );
    }
 
+   /**
+    *  Adds `delta` to the weight proxied to `proxy`. With `defer`, the change is added to the proxy's
+    *  pending weight instead of being cast right away while the pending weight stays below the thresholds
+    *  of `vote_debounce_parameters`; the proxy is then listed in `pendproxies` until the weight is cast.
+    */
+   void system_contract::update_proxied_weight( const voter_info2& proxy, int128_t delta, bool defer, const name& payer ) {
+      auto pending_itr = _pending_proxies.find( proxy.owner.value );
+      const int128_t pending = ( pending_itr != _pending_proxies.end() ? pending_itr->weight : 0 ) + delta;
+      defer = defer && proxy.is_proxy() && defer_weight_change( pending, proxy.weight() );
+      _voters.modify( proxy, same_payer, [&]( auto& p ) {
+            p.set_weights( p.weight(), p.proxied_weight() + delta );
+         }
+      );
+      if ( !defer ) {
+         propagate_weight_change( proxy );
+      } else if ( pending == 0 ) {
+         if ( pending_itr != _pending_proxies.end() )
+            _pending_proxies.erase( pending_itr );
+      } else if ( pending_itr != _pending_proxies.end() ) {
+         _pending_proxies.modify( pending_itr, same_payer, [&]( auto& pp ) {
+               pp.weight = pending;
+            }
+         );
+      } else {
+         _pending_proxies.emplace( payer, [&]( auto& pp ) {
+               pp.proxy  = proxy.owner;
+               pp.weight = pending;
+            }
+         );
+      }
+   }
+
+   /**
+    *  Returns the stake change of a voter not cast yet. Only voters with a vote defer stake changes.
+    */
+   int64_t system_contract::pending_stake_of( const voter_info2& voter )const {
+      if ( !voter.has_vote() )
+         return 0;
+      auto itr = _pending_stakes.find( voter.owner.value );
+      return itr != _pending_stakes.end() ? itr->stake : 0;
+   }
+
+   /**
+    *  Returns the part of the weight proxied to `proxy` not cast yet.
+    */
+   int128_t system_contract::pending_proxied_of( const voter_info2& proxy )const {
+      auto itr = _pending_proxies.find( proxy.owner.value );
+      return itr != _pending_proxies.end() ? itr->weight : 0;
+   }
+
+   /**
+    *  Removes the changes of a voter not cast yet, once its weight is recomputed from its stake.
+    */
+   void system_contract::clear_pending_changes( const voter_info2& voter ) {
+      if ( voter.has_vote() ) {
+         auto stake_itr = _pending_stakes.find( voter.owner.value );
+         if ( stake_itr != _pending_stakes.end() )
+            _pending_stakes.erase( stake_itr );
+      }
+      // also listed after unregistering as a proxy, until the weight is recomputed
+      auto itr = _pending_proxies.find( voter.owner.value );
+      if ( itr != _pending_proxies.end() )
+         _pending_proxies.erase( itr );
+   }
+
+   /**
+    *  Decides whether the pending weight of a proxy or a vote set is left for later, with the thresholds
+    *  that apply to stake changes, see `vote_debounce_parameters`. `cast_weight` is the weight the votes
+    *  were cast with.
+    */
+   bool system_contract::defer_weight_change( int128_t pending, int128_t cast_weight ) {
+      const auto& params = vote_debounce();
+      if ( params.min_stake_delta == 0 && params.min_stake_delta_bp == 0 ) {
+         return false;
+      }
+      const int128_t change = pending < 0 ? -pending : pending;
+      return ( params.min_stake_delta == 0 || change < stake2vote( params.min_stake_delta ) ) &&
+             ( params.min_stake_delta_bp == 0 || change * 10000 < cast_weight * params.min_stake_delta_bp );
+   }
+
+   /**
+    *  Casts the pending weight of up to `max` proxies. The producers of all of them are written once.
+    */
+   void system_contract::flush_pending_proxies( uint32_t max ) {
+      const bool defer_vote_deltas = _defer_vote_deltas;
+      _defer_vote_deltas = true;
+      for ( uint32_t i = 0; i < max && _pending_proxies.begin() != _pending_proxies.end(); ++i ) {
+         // casting the weight removes the proxy from the table
+         propagate_weight_change( get_voter( _pending_proxies.begin()->proxy, "pending proxy not found" ) ); //data corruption
+      }
+      _defer_vote_deltas = defer_vote_deltas;
+      if ( !_defer_vote_deltas ) {
+         flush_vote_deltas();
+      }
+   }
+
+   void system_contract::flushproxies( const name& user, uint16_t max ) {
+      require_auth( user );
+
+      check( max > 0, "max must be positive" );
+      check( _pending_proxies.begin() != _pending_proxies.end(), "no proxies with pending vote weight" );
+      flush_pending_proxies( max );
+   }
+
+   const std::vector<name>& system_contract::voted_producers( const voter_info2& voter )const {
+      static const std::vector<name> no_producers;
+      if ( voter.vote_set() ) {
+         return _vote_sets.get( voter.vote_set(), "vote set not found" ).producers; //data corruption
+      }
+      return no_producers;
+   }
+
+   /**
+    *  Returns the vote set of `producers`, which must be sorted, creating it at the expense of `payer`
+    *  when no voter votes for these producers yet.
+    */
+   const vote_set& system_contract::intern_vote_set( const std::vector<name>& producers, const name& payer ) {
+      const auto packed = arisen::pack( producers );
+      const auto digest = arisen::sha256( packed.data(), packed.size() );
+      auto idx = _vote_sets.get_index<"bydigest"_n>();
+      auto itr = idx.find( digest );
+      if ( itr != idx.end() ) {
+         check( itr->producers == producers, "vote set digest collision" );
+         return *itr;
+      }
+      return *_vote_sets.emplace( payer, [&]( auto& s ) {
+            s.id        = std::max<uint64_t>( _vote_sets.available_primary_key(), 1 );
+            s.digest    = digest;
+            s.producers = producers;
+            // sets created by the migration wait for a voter of the set to take them over
+            if ( payer != get_self() )
+               s.payer = payer;
+         }
+      );
+   }
+
+   /**
+    *  Returns the voter's `voters2` row, moving the voter over from the `voters` table first if
+    *  `migratevotes` has not reached it yet. Returns the end iterator for accounts without a voter row.
+    */
+   voters_table2::const_iterator system_contract::find_voter( const name& voter ) {
+      auto itr = _voters.find( voter.value );
+      if ( itr != _voters.end() )
+         return itr;
+      auto legacy = _legacy_voters.find( voter.value );
+      if ( legacy == _legacy_voters.end() )
+         return itr;
+      return migrate_voter( legacy );
+   }
+
+   const voter_info2& system_contract::get_voter( const name& voter, const char* error_msg ) {
+      auto itr = find_voter( voter );
+      check( itr != _voters.end(), error_msg );
+      return *itr;
+   }
+
+   /**
+    *  Moves a voter row into the `voters2` table. A producer list still stored in the row moves into its
+    *  vote set, which takes the voter's weight, already included in the producers' totals, over as cast
+    *  weight.
+    */
+   voters_table2::const_iterator system_contract::migrate_voter( const voters_table::const_iterator& legacy ) {
+      const int128_t weight = legacy->weight();
+      uint64_t set_id = legacy->vote_set();
+      if ( !set_id && !legacy->proxy && !legacy->producers.empty() ) {
+         // the contract pays for new sets until a voter of the set takes them over, so that the migration
+         // does not grow the RAM of the voters it moves
+         const auto& set = intern_vote_set( legacy->producers, get_self() );
+         _vote_sets.modify( set, same_payer, [&]( auto& s ) {
+               s.weight      += weight;
+               s.cast_weight += weight;
+               ++s.voters;
+            }
+         );
+         set_id = set.id;
+      }
+
+      voter_info2 row;
+      row.owner  = legacy->owner;
+      row.proxy  = legacy->proxy;
+      row.staked = legacy->staked;
+      row.flags  = set_field( static_cast<uint8_t>( legacy->flags1 ), voter_info2::flags_fields::is_proxy, legacy->is_proxy );
+      row.set_vote_set( set_id );
+      row.set_weights( weight, legacy->proxied_weight() );
+
+      if ( legacy->pending() != 0 ) {
+         _pending_stakes.emplace( legacy->owner, [&]( auto& p ) {
+               p.voter = legacy->owner;
+               p.stake = legacy->pending();
+            }
+         );
+      }
+      if ( legacy->pending_proxied() != 0 ) {
+         _pending_proxies.modify( _pending_proxies.get( legacy->owner.value, "pending proxy not found" ), same_payer, //data corruption
+            [&]( auto& pp ) {
+               pp.weight = legacy->pending_proxied();
+            }
+         );
+      }
+
+      // the voter paid for the row it replaces and keeps paying for the new one, which is never larger;
+      // should it be, the contract pays, so that migratevotes cannot be stopped by an account out of RAM
+      const name payer = arisen::pack_size( row ) <= arisen::pack_size( *legacy ) ? legacy->owner : get_self();
+      _legacy_voters.erase( legacy );
+      return _voters.emplace( payer, [&]( voter_info2& v ) {
+            v = row;
+         }
+      );
+   }
+
+   void system_contract::migratevotes( uint32_t max_rows ) {
+      require_auth( get_self() );
+
+      check( max_rows > 0, "max_rows must be positive" );
+      check( _legacy_voters.begin() != _legacy_voters.end(), "votes have already been migrated" );
+
+      // moved rows leave the table, so the first row left is where the previous call stopped
+      for ( uint32_t i = 0; i < max_rows && _legacy_voters.begin() != _legacy_voters.end(); ++i ) {
+         migrate_voter( _legacy_voters.begin() );
+      }
+   }
+
+   /**
+    *  Casts the pending weight of a vote set, or, unless `flush` is set, lists the set in `pendvotesets`
+    *  at the expense of `payer` while the pending weight stays below the thresholds of
+    *  `vote_debounce_parameters`. A set without voters has nothing left to cast once flushed and is removed.
+    */
+   void system_contract::settle_vote_set( const vote_set& set, bool flush, const name& payer ) {
+      if ( !flush && set.voters > 0 && defer_weight_change( set.weight - set.cast_weight, set.cast_weight ) ) {
+         if ( !set.pending ) {
+            _pending_vote_sets.emplace( payer, [&]( auto& p ) {
+                  p.set_id = set.id;
+               }
+            );
+            _vote_sets.modify( set, same_payer, [&]( auto& s ) {
+                  s.pending = true;
+               }
+            );
+         }
+         return;
+      }
+
+      if ( set.weight != set.cast_weight ) {
+         apply_vote_deltas( set.producers, set.cast_weight, set.producers, set.weight, false );
+      }
+      if ( set.pending ) {
+         _pending_vote_sets.erase( _pending_vote_sets.get( set.id, "pending vote set not found" ) ); //data corruption
+      }
+      if ( set.voters == 0 ) {
+         _vote_sets.erase( set );
+      } else if ( set.weight != set.cast_weight || set.pending ) {
+         _vote_sets.modify( set, same_payer, [&]( auto& s ) {
+               s.cast_weight = s.weight;
+               s.pending     = false;
+            }
+         );
+      }
+   }
+
+   /**
+    *  Casts the pending weight of up to `max` vote sets. The producers of all of them are written once.
+    */
+   void system_contract::flush_pending_vote_sets( uint32_t max ) {
+      const bool defer_vote_deltas = _defer_vote_deltas;
+      _defer_vote_deltas = true;
+      for ( uint32_t i = 0; i < max && _pending_vote_sets.begin() != _pending_vote_sets.end(); ++i ) {
+         // casting the weight removes the set from the table
+         settle_vote_set( _vote_sets.get( _pending_vote_sets.begin()->set_id, "pending vote set not found" ), true ); //data corruption
+      }
+      _defer_vote_deltas = defer_vote_deltas;
+      if ( !_defer_vote_deltas ) {
+         flush_vote_deltas();
+      }
+   }
+
+   void system_contract::flushvotesets( const name& user, uint16_t max ) {
+      require_auth( user );
+
+      check( max > 0, "max must be positive" );
+      check( _pending_vote_sets.begin() != _pending_vote_sets.end(), "no vote sets with pending vote weight" );
+      flush_pending_vote_sets( max );
+   }
+
 } /// namespace arisensystem
@@ -0,0 +1,103 @@
+/**
+ * Native benchmark of the Bancor connector math used by the RAM market and the COM pool.
+ *
+ * Compares the former double precision implementation with the integer implementations from
+ * arisen.system/bancor.hpp and verifies on the way that the compatibility mode reproduces the
+ * double results. Native timings only give relative numbers: inside the contract every floating
+ * point operation goes through the deterministic software float implementation of the VM, which
+ * makes the double version considerably more expensive than it is here.
+ *
+ * Usage: bancor_benchmark [iterations]
+ */
+#include <arisen.system/bancor.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace {
+
+   using namespace arisensystem;
+
+   int64_t double_output( int64_t inp_reserve, int64_t out_reserve, int64_t inp ) {
+      const double ib = inp_reserve;
+      const double ob = out_reserve;
+      const double in = inp;
+      int64_t out = int64_t( (in * ob) / (ib + in) );
+      return out < 0 ? 0 : out;
+   }
+
+   int64_t double_input( int64_t out_reserve, int64_t inp_reserve, int64_t out ) {
+      const double ob = out_reserve;
+      const double ib = inp_reserve;
+      int64_t inp = (ib * out) / (ob - out);
+      return inp < 0 ? 0 : inp;
+   }
+
+   struct sample {
+      int64_t reserve_a;
+      int64_t reserve_b;
+      int64_t amount;
+   };
+
+   template<typename F>
+   double measure( const char* label, const std::vector<sample>& samples, F&& f ) {
+      int64_t checksum = 0;
+      const auto start = std::chrono::steady_clock::now();
+      for( const auto& s : samples ) {
+         checksum += f( s.reserve_a, s.reserve_b, s.amount );
+      }
+      const auto stop = std::chrono::steady_clock::now();
+      const double ns = std::chrono::duration<double, std::nano>( stop - start ).count() / samples.size();
+      std::printf( "   %-18s %8.2f ns/op   (checksum %lld)\n", label, ns, static_cast<long long>(checksum) );
+      return ns;
+   }
+
+}
+
+int main( int argc, char** argv ) {
+   const size_t iterations = argc > 1 ? std::strtoull( argv[1], nullptr, 10 ) : 5'000'000;
+
+   // values in the ranges seen on chain: RAM connector balances, core token connector and
+   // COM pool balances (up to 10^15 with 4 decimals) and purchase amounts up to the balance
+   std::mt19937_64 gen( 42 );
+   std::vector<sample> samples;
+   samples.reserve( iterations );
+   while( samples.size() < iterations ) {
+      const int64_t reserve_a = 1 + int64_t( gen() % 1'000'000'000'000'000ll );
+      const int64_t reserve_b = 1 + int64_t( gen() % 1'000'000'000'000'000ll );
+      const int64_t amount    = 1 + int64_t( gen() % uint64_t(reserve_a < reserve_b ? reserve_a : reserve_b) );
+      samples.push_back( { reserve_a, reserve_b, amount } );
+   }
+
+   size_t mismatches = 0;
+   for( const auto& s : samples ) {
+      if( double_output( s.reserve_a, s.reserve_b, s.amount ) != bancor::compat::get_bancor_output( s.reserve_a, s.reserve_b, s.amount ) )
+         ++mismatches;
+      // skip the inputs for which the double version overflows int64_t
+      if( s.amount < s.reserve_a && double(s.reserve_b) * s.amount / (double(s.reserve_a) - s.amount) < 9e18 &&
+          double_input( s.reserve_a, s.reserve_b, s.amount ) != bancor::compat::get_bancor_input( s.reserve_a, s.reserve_b, s.amount ) )
+         ++mismatches;
+   }
+
+   std::printf( "%zu samples, %zu compatibility mismatches\n\n", samples.size(), mismatches );
+
+   std::printf( "get_bancor_output\n" );
+   measure( "double",  samples, double_output );
+   measure( "compat",  samples, bancor::compat::get_bancor_output );
+   measure( "exact",   samples, bancor::exact::get_bancor_output );
+
+   // keep the inputs below the output reserve, as the contract does
+   for( auto& s : samples ) {
+      if( s.amount >= s.reserve_a ) s.amount = s.reserve_a - 1;
+   }
+
+   std::printf( "get_bancor_input\n" );
+   measure( "double",  samples, double_input );
+   measure( "compat",  samples, bancor::compat::get_bancor_input );
+   measure( "exact",   samples, bancor::exact::get_bancor_input );
+
+   return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,163 @@
+/**
+ * Native simulation of the producer pay and inflation from arisen.system/producer_pay.hpp.
+ *
+ * Registers a number of producers with a skewed distribution of votes, lets the 21 with the most votes produce
+ * the blocks in rounds of 12 and has every producer claim its rewards periodically, each at its own offset. A
+ * claim funds the buckets with the inflation since the last fill and pays the producer with the same code as
+ * `claimrewards`. Reports the issued tokens, the pay by rank and the throughput, and checks that the pay and
+ * the buckets add up to the producers' part of the inflation.
+ *
+ * Usage: producer_pay_sim [producers] [days] [claim_hours] [continuous_rate]
+ */
+#include <arisen.system/producer_pay.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <numeric>
+#include <queue>
+#include <utility>
+#include <vector>
+
+namespace {
+
+   using namespace arisensystem;
+
+   constexpr int64_t  block_interval_us  = 500'000;
+   constexpr int64_t  useconds_per_day   = int64_t(24 * 3600) * 1000'000;
+   constexpr int64_t  useconds_per_year  = int64_t(52 * 7 * 24 * 3600) * 1000'000;
+   constexpr size_t   schedule_size      = 21;
+   constexpr uint32_t blocks_per_turn    = 12;
+   constexpr int64_t  start_time         = int64_t(1'600'000'000) * 1000'000; // any time after the epoch
+   constexpr int64_t  initial_supply     = 1'000'000'000'0000;
+   constexpr int64_t  voting_stake       = 400'000'000'0000;
+
+   struct account {
+      producer_pay::producer state;
+      int64_t                block_pay = 0;
+      int64_t                vote_pay  = 0;
+      uint64_t               claims    = 0;
+   };
+
+   void report( const char* label, const account& a, double days ) {
+      std::printf( "   %-10s block pay %14.4f   vote pay %14.4f   per day %12.4f   claims %llu\n", label,
+                   a.block_pay / 1e4, a.vote_pay / 1e4, (a.block_pay + a.vote_pay) / 1e4 / days,
+                   static_cast<unsigned long long>(a.claims) );
+   }
+
+}
+
+int main( int argc, char** argv ) {
+   const size_t  producer_count = argc > 1 ? std::strtoull( argv[1], nullptr, 10 ) : 100;
+   const int64_t days           = argc > 2 ? std::strtoll( argv[2], nullptr, 10 ) : 365;
+   const double  claim_hours    = argc > 3 ? std::strtod( argv[3], nullptr ) : 24.5;
+   const double  rate           = argc > 4 ? std::strtod( argv[4], nullptr ) : 0.04879;
+
+   if( producer_count < schedule_size || days <= 0 || claim_hours <= 24 ) {
+      std::fprintf( stderr, "needs at least %zu producers, a positive number of days and claims more than 24 hours apart\n", schedule_size );
+      return EXIT_FAILURE;
+   }
+
+   // the constants of arisen.system.hpp, with the inflation rate of the study
+   const producer_pay::parameters params{ rate, 5, 4, 100'0000, useconds_per_year };
+   const int64_t claim_interval = int64_t( claim_hours * 3600 ) * 1000'000;
+
+   // votes fall off with the rank, as they do on live chains, and accrue votepay shares from the start
+   std::vector<account> producers( producer_count );
+   std::vector<double>  weights( producer_count );
+   for( size_t i = 0; i < producer_count; ++i )
+      weights[i] = 1.0 / std::pow( double(i + 1), 0.8 );
+   const double weight_sum = std::accumulate( weights.begin(), weights.end(), 0.0 );
+
+   producer_pay::votepay_totals totals{ 0, 0, start_time };
+   for( size_t i = 0; i < producer_count; ++i ) {
+      auto& p = producers[i].state;
+      p.votes           = vote_weight::stake_to_weight( int64_t( voting_stake * weights[i] / weight_sum ), 1000 );
+      p.last_claim_time = start_time;
+      p.votepay         = { 0, start_time };
+      totals.change_rate += p.votes;
+   }
+
+   producer_pay::buckets buckets;
+   int64_t supply      = initial_supply;
+   int64_t last_fill   = start_time;
+   int64_t issued      = 0;
+   int64_t to_savings  = 0;
+   int64_t to_pay      = 0;
+   uint64_t claim_count = 0;
+
+   // next claim time of every producer, spread over the claim interval
+   using next_claim = std::pair<int64_t, size_t>;
+   std::priority_queue<next_claim, std::vector<next_claim>, std::greater<next_claim>> claims;
+   for( size_t i = 0; i < producer_count; ++i )
+      claims.emplace( start_time + useconds_per_day + 1 + int64_t( i * (claim_interval - useconds_per_day) / producer_count ), i );
+
+   const uint64_t block_count = uint64_t( days * useconds_per_day / block_interval_us );
+   const auto wall_start = std::chrono::steady_clock::now();
+
+   for( uint64_t block = 0; block < block_count; ++block ) {
+      const int64_t now = start_time + int64_t(block) * block_interval_us;
+
+      // the producers are ranked by votes, which do not change, so the schedule is the first 21 of them
+      auto& prod = producers[ (block / blocks_per_turn) % schedule_size ].state;
+      ++prod.unpaid_blocks;
+      ++buckets.total_unpaid_blocks;
+
+      while( !claims.empty() && claims.top().first <= now ) {
+         const size_t i = claims.top().second;
+         claims.pop();
+
+         // claimrewards fills the buckets first
+         const auto inflation = producer_pay::inflation( params, supply, now - last_fill );
+         supply                 += inflation.total;
+         issued                 += inflation.total;
+         to_savings             += inflation.to_savings;
+         to_pay                 += inflation.to_per_block_pay + inflation.to_per_vote_pay;
+         buckets.perblock_bucket += inflation.to_per_block_pay;
+         buckets.pervote_bucket  += inflation.to_per_vote_pay;
+         last_fill               = now;
+
+         auto& a = producers[i];
+         const auto pay = producer_pay::claim( params, buckets, totals, a.state, now, true, 0 );
+         a.block_pay += pay.per_block;
+         a.vote_pay  += pay.per_vote;
+         ++a.claims;
+         ++claim_count;
+
+         claims.emplace( now + claim_interval, i );
+      }
+   }
+
+   const double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - wall_start ).count();
+
+   int64_t paid = 0;
+   uint64_t unpaid_blocks = 0;
+   for( const auto& a : producers ) {
+      paid          += a.block_pay + a.vote_pay;
+      unpaid_blocks += a.state.unpaid_blocks;
+   }
+
+   std::printf( "%zu producers, %lld days, claims every %.1f hours, continuous rate %.5f\n", producer_count,
+                static_cast<long long>(days), claim_hours, rate );
+   std::printf( "%llu blocks and %llu claims in %.3f s, %.2f M blocks/s\n", static_cast<unsigned long long>(block_count),
+                static_cast<unsigned long long>(claim_count), seconds, block_count / seconds / 1e6 );
+   std::printf( "issued %.4f (%.3f%% of the initial supply), savings %.4f, producer pay %.4f\n", issued / 1e4,
+                100.0 * issued / initial_supply, to_savings / 1e4, to_pay / 1e4 );
+   std::printf( "paid %.4f, left in the buckets %.4f per-block and %.4f per-vote\n", paid / 1e4,
+                buckets.perblock_bucket / 1e4, buckets.pervote_bucket / 1e4 );
+   std::printf( "pay by rank\n" );
+   report( "first",    producers[0],                  double(days) );
+   report( "21st",     producers[schedule_size - 1],  double(days) );
+   report( "22nd",     producers[schedule_size],      double(days) );
+   report( "last",     producers.back(),              double(days) );
+
+   // every token issued for the producers is either paid or still in a bucket, and every block is counted once
+   const bool balanced = paid + buckets.perblock_bucket + buckets.pervote_bucket == to_pay &&
+                         unpaid_blocks == buckets.total_unpaid_blocks;
+   if( !balanced )
+      std::printf( "pay and buckets do not add up to the producer pay\n" );
+   return balanced ? EXIT_SUCCESS : EXIT_FAILURE;
+}
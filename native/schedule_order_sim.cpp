@@ -0,0 +1,99 @@
+/**
+ * Native simulation of the producer schedule orderings from arisen.system/producer_schedule.hpp.
+ *
+ * Draws random sets of 21 elected producers, arranges each set in name order and in location order
+ * and reports the summed handoff distance of one round for both. Locations are drawn from a few
+ * regions with a spread around their center, as producers tend to be hosted in the same areas, or
+ * uniformly over the ring with the `uniform` argument. Distances are in location codes, a full
+ * turn of the ring being 65536.
+ *
+ * Usage: schedule_order_sim [rounds] [uniform]
+ */
+#include <arisen.system/producer_schedule.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+   using namespace arisensystem;
+
+   struct producer {
+      std::string name;
+      uint32_t    location;
+   };
+
+   struct stats {
+      uint64_t total = 0;
+      uint64_t min   = UINT64_MAX;
+      uint64_t max   = 0;
+
+      void add( uint64_t v ) {
+         total += v;
+         if( v < min ) min = v;
+         if( v > max ) max = v;
+      }
+   };
+
+   uint64_t round_length( std::vector<producer> producers, producer_schedule::order o ) {
+      std::sort( producers.begin(), producers.end(), []( const auto& a, const auto& b ) { return a.name < b.name; } );
+      producer_schedule::arrange( producers.begin(), producers.end(), o, []( const auto& p ) { return p.location; } );
+      return producer_schedule::tour_length( producers.begin(), producers.end(), []( const auto& p ) { return p.location; } );
+   }
+
+   void report( const char* label, const stats& s, size_t rounds ) {
+      std::printf( "   %-12s mean %8.0f   min %6llu   max %6llu   (%.2f turns of the ring)\n", label,
+                   double(s.total) / rounds, static_cast<unsigned long long>(s.min), static_cast<unsigned long long>(s.max),
+                   double(s.total) / rounds / producer_schedule::location_ring );
+   }
+
+}
+
+int main( int argc, char** argv ) {
+   const size_t rounds  = argc > 1 ? std::strtoull( argv[1], nullptr, 10 ) : 100'000;
+   const bool   uniform = argc > 2 && std::strcmp( argv[2], "uniform" ) == 0;
+
+   constexpr size_t schedule_size = 21;
+   // region centers on the ring and the spread of the locations around them
+   const uint32_t regions[] = { 5'000, 12'000, 30'000, 45'000, 58'000 };
+   constexpr int32_t spread = 2'000;
+
+   std::mt19937_64 gen( 42 );
+   std::uniform_int_distribution<uint32_t> any_location( 0, producer_schedule::location_ring - 1 );
+   std::uniform_int_distribution<size_t>   any_region( 0, std::size(regions) - 1 );
+   std::uniform_int_distribution<int32_t>  offset( -spread, spread );
+   std::uniform_int_distribution<int>      letter( 'a', 'z' );
+
+   stats by_name, by_location;
+   size_t longer_tours = 0;
+   std::vector<producer> producers( schedule_size );
+   for( size_t r = 0; r < rounds; ++r ) {
+      for( auto& p : producers ) {
+         p.name.assign( 12, 'a' );
+         for( auto& c : p.name ) c = char( letter(gen) );
+         p.location = uniform ? any_location(gen)
+                              : uint32_t( int32_t(regions[any_region(gen)]) + offset(gen) ) % producer_schedule::location_ring;
+      }
+      const uint64_t name_length     = round_length( producers, producer_schedule::by_name );
+      const uint64_t location_length = round_length( producers, producer_schedule::by_location );
+      by_name.add( name_length );
+      by_location.add( location_length );
+      // the location order is the shortest cyclic tour, it can never be longer than the name order
+      if( location_length > name_length )
+         ++longer_tours;
+   }
+
+   std::printf( "%zu schedules of %zu producers, %s locations\n", rounds, schedule_size, uniform ? "uniform" : "clustered" );
+   std::printf( "summed handoff distance per round\n" );
+   report( "by_name",     by_name,     rounds );
+   report( "by_location", by_location, rounds );
+   std::printf( "%zu rounds with a longer tour in location order\n", longer_tours );
+
+   return longer_tours == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
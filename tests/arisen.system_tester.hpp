@@ -3,6 +3,7 @@
 #include <arisen/testing/tester.hpp>
 #include <arisen/chain/abi_serializer.hpp>
 #include <arisen/chain/resource_limits.hpp>
+#include <arisen.system/vote_weight.hpp>
 #include "contracts.hpp"
 #include "test_symbol.hpp"
 
@@ -55,8 +56,12 @@ public:
    }
 
    void deploy_contract( bool call_init = true ) {
-      set_code( config::system_account_name, contracts::system_wasm() );
-      set_abi( config::system_account_name, contracts::system_abi().data() );
+      deploy_contract( contracts::system_wasm(), contracts::system_abi(), call_init );
+   }
+
+   void deploy_contract( const std::vector<uint8_t>& wasm, const std::vector<char>& abi, bool call_init = true ) {
+      set_code( config::system_account_name, wasm );
+      set_abi( config::system_account_name, abi.data() );
       if( call_init ) {
          base_tester::push_action(config::system_account_name, N(init),
                                                config::system_account_name,  mutable_variant_object()
@@ -253,6 +258,10 @@ public:
       return push_action( payer, N(buyrambytes), mvo()( "payer",payer)("receiver",receiver)("bytes",numbytes) );
    }
 
+   action_result buyrambatch( const account_name& payer, const std::vector<mvo>& purchases ) {
+      return push_action( payer, N(buyrambatch), mvo()( "payer",payer)("purchases",purchases) );
+   }
+
    action_result sellram( const account_name& account, uint64_t numbytes ) {
       return push_action( account, N(sellram), mvo()( "account", account)("bytes",numbytes) );
    }
@@ -711,6 +720,34 @@ public:
                          ("producers", producers));
    }
 
+   action_result bulkvote( const std::vector<mvo>& votes ) {
+      action act;
+      act.account = config::system_account_name;
+      act.name    = N(bulkvote);
+      act.data    = abi_ser.variant_to_binary( abi_ser.get_action_type(N(bulkvote)), mvo()("votes", votes), abi_serializer_max_time );
+
+      std::set<account_name> voters;
+      for( const auto& v : votes ) {
+         voters.insert( v["voter"].as<account_name>() );
+      }
+      for( const auto& v : voters ) {
+         act.authorization.push_back( permission_level{ v, config::active_name } );
+      }
+
+      signed_transaction trx;
+      trx.actions.push_back( std::move(act) );
+      set_transaction_headers( trx );
+      for( const auto& v : voters ) {
+         trx.sign( get_private_key( v, "active" ), control->get_chain_id() );
+      }
+      try {
+         push_transaction( trx );
+      } catch( const fc::exception& ex ) {
+         return error( ex.top_message() );
+      }
+      return success();
+   }
+
    uint32_t last_block_time() const {
       return time_point_sec( control->head_block_time() ).sec_since_epoch();
    }
@@ -725,19 +762,119 @@ public:
       return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "user_resources", data, abi_serializer_max_time );
    }
 
+   // voters2 row in the layout of the former voters row, which is read instead for voters that have not been
+   // migrated, with the producers of the vote set the row references and the changes not cast yet
    fc::variant get_voter_info( const account_name& act ) {
-      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(voters), act );
-      return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "voter_info", data, abi_serializer_max_time );
+      fc::variant voter = get_voter_info2( act );
+      if( voter.is_null() ) {
+         vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(voters), act );
+         if( data.empty() ) return fc::variant();
+         voter = abi_ser.binary_to_variant( "voter_info", data, abi_serializer_max_time );
+      } else {
+         // fields that are not written yet are 0
+         auto field = [&]( const char* name ) { return voter.get_object().contains( name ) ? voter[name] : fc::variant( "0" ); };
+         const auto flags   = voter["flags"].as_uint64();
+         const auto stake   = get_pending_stake( act );
+         const auto proxied = get_pending_proxy( act );
+         voter = mutable_variant_object( voter.get_object() )
+            ( "producers",                 variants() )
+            ( "vote_set_id",               field( "vote_set_id" ).as_uint64() )
+            ( "last_vote_weight",          arisensystem::vote_weight::to_double( to_int128( field( "last_vote_weight" ) ) ) )
+            ( "proxied_vote_weight",       arisensystem::vote_weight::to_double( to_int128( field( "proxied_vote_weight" ) ) ) )
+            ( "is_proxy",                  ( flags & 8 ) != 0 )
+            ( "flags1",                    flags & 7 )
+            ( "fixed_last_vote_weight",    field( "last_vote_weight" ) )
+            ( "fixed_proxied_vote_weight", field( "proxied_vote_weight" ) )
+            ( "pending_stake",             stake.is_null() ? 0 : stake["stake"].as_int64() )
+            ( "pending_proxied_weight",    proxied.is_null() ? fc::variant( "0" ) : proxied["weight"] );
+      }
+      if( !voter.get_object().contains( "vote_set_id" ) || voter["vote_set_id"].as_uint64() == 0 ) return voter;
+      return mutable_variant_object( voter.get_object() )
+         ( "producers", get_vote_set( voter["vote_set_id"].as_uint64() )["producers"] );
+   }
+
+   fc::variant get_voter_info2( const account_name& act ) {
+      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(voters2), act );
+      return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "voter_info2", data, abi_serializer_max_time );
    }
 
+   fc::variant get_pending_stake( const account_name& act ) {
+      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(pendstakes), act );
+      return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "voter_pending_stake", data, abi_serializer_max_time );
+   }
+
+   fc::variant get_pending_proxy( const account_name& act ) {
+      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(pendproxies), act );
+      return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "pending_proxy", data, abi_serializer_max_time );
+   }
+
+   // 128-bit integers are represented by their decimal string
+   static __int128 to_int128( const fc::variant& v ) {
+      const auto str = v.as_string();
+      const bool negative = !str.empty() && str[0] == '-';
+      __int128 result = 0;
+      for( size_t i = negative ? 1 : 0; i < str.size(); ++i ) {
+         result = result * 10 + ( str[i] - '0' );
+      }
+      return negative ? -result : result;
+   }
+
+   fc::variant get_vote_set( uint64_t id ) {
+      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(votesets), account_name(id) );
+      return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "vote_set", data, abi_serializer_max_time );
+   }
+
+   fc::variant get_pay_credit( const account_name& act ) {
+      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(paycredits), act );
+      return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "pay_credit", data, abi_serializer_max_time );
+   }
+
+   // producer row with the blocks of the running round, which are only added to the row once the round ends
    fc::variant get_producer_info( const account_name& act ) {
-      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(producers), act );
-      return abi_ser.binary_to_variant( "producer_info", data, abi_serializer_max_time );
+      auto prod = get_producer_info_row( act );
+      const auto buffer = get_unpaid_blocks_buffer();
+      if( buffer.is_null() || buffer["producer"].as<account_name>() != act ) return prod;
+      return mutable_variant_object( prod.get_object() )
+         ( "unpaid_blocks", prod["unpaid_blocks"].as<uint32_t>() + buffer["blocks"].as<uint32_t>() );
+   }
+
+   // prodstats and prodconfig rows merged into the layout of the former producers row, which is read
+   // instead for producers that have not been migrated
+   fc::variant get_producer_info_row( const account_name& act ) {
+      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(prodstats), act );
+      if( data.empty() ) {
+         data = get_row_by_account( config::system_account_name, config::system_account_name, N(producers), act );
+         return abi_ser.binary_to_variant( "producer_info", data, abi_serializer_max_time );
+      }
+      mutable_variant_object prod( abi_ser.binary_to_variant( "producer_stats", data, abi_serializer_max_time ).get_object() );
+      data = get_row_by_account( config::system_account_name, config::system_account_name, N(prodconfig), act );
+      const auto config = abi_ser.binary_to_variant( "producer_config", data, abi_serializer_max_time );
+      return prod( "producer_key", config["producer_key"] )( "url", config["url"] )( "location", config["location"] );
    }
 
+   fc::variant get_unpaid_blocks_buffer() {
+      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(unpaidblocks), N(unpaidblocks) );
+      return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "unpaid_blocks_buffer", data, abi_serializer_max_time );
+   }
+
+   fc::variant get_producer_ranking() {
+      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(prodranking), N(prodranking) );
+      return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "producer_ranking", data, abi_serializer_max_time );
+   }
+
+   // votepay accounting of a producer, read from its producer row once it has been moved there
    fc::variant get_producer_info2( const account_name& act ) {
+      const auto prod = get_producer_info( act );
+      if( prod.get_object().contains( "votepay" ) &&
+          prod["votepay"]["last_votepay_share_update"].as<fc::time_point>() != fc::time_point() ) {
+         return mutable_variant_object( prod["votepay"].get_object() )( "owner", act );
+      }
+      return get_producer_info2_row( act );
+   }
+
+   fc::variant get_producer_info2_row( const account_name& act ) {
       vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(producers2), act );
-      return abi_ser.binary_to_variant( "producer_info2", data, abi_serializer_max_time );
+      return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "producer_info2", data, abi_serializer_max_time );
    }
 
    void create_currency( name contract, name manager, asset maxsupply ) {
@@ -793,7 +930,8 @@ public:
 
    double stake2votes( asset stake ) {
       auto now = control->pending_block_time().time_since_epoch().count() / 1000000;
-      return stake.get_amount() * pow(2, int64_t((now - (config::block_timestamp_epoch / 1000)) / (86400 * 7))/ double(52) ); // 52 week periods (i.e. ~years)
+      const uint32_t weeks = (now - (config::block_timestamp_epoch / 1000)) / (86400 * 7); // 52 week periods (i.e. ~years)
+      return arisensystem::vote_weight::to_double( arisensystem::vote_weight::stake_to_weight( stake.get_amount(), weeks ) );
    }
 
    double stake2votes( const string& s ) {
@@ -815,18 +953,40 @@ public:
       return static_cast<uint64_t>( time_point::from_iso_string( v.as_string() ).time_since_epoch().count() );
    }
 
+   fc::variant get_global_record() {
+      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(globalstate), N(globalstate) );
+      return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "arisen_global_record", data, abi_serializer_max_time );
+   }
+
+   // the get_global_state* helpers read the consolidated record if it exists and fall back to the legacy singletons
+
+   // global state with the blocks of the running round counted in total_unpaid_blocks, see get_producer_info()
    fc::variant get_global_state() {
+      auto gstate = get_global_state_row();
+      const auto buffer = get_unpaid_blocks_buffer();
+      if( gstate.is_null() || buffer.is_null() ) return gstate;
+      return mutable_variant_object( gstate.get_object() )
+         ( "total_unpaid_blocks", gstate["total_unpaid_blocks"].as<uint32_t>() + buffer["blocks"].as<uint32_t>() );
+   }
+
+   fc::variant get_global_state_row() {
+      fc::variant record = get_global_record();
+      if( !record.is_null() ) return record["gstate"];
       vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(global), N(global) );
       if (data.empty()) std::cout << "\nData is empty\n" << std::endl;
       return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "arisen_global_state", data, abi_serializer_max_time );
    }
 
    fc::variant get_global_state2() {
+      fc::variant record = get_global_record();
+      if( !record.is_null() ) return record["gstate2"];
       vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(global2), N(global2) );
       return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "arisen_global_state2", data, abi_serializer_max_time );
    }
 
    fc::variant get_global_state3() {
+      fc::variant record = get_global_record();
+      if( !record.is_null() ) return record["gstate3"];
       vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(global3), N(global3) );
       return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "arisen_global_state3", data, abi_serializer_max_time );
    }
@@ -958,6 +1118,38 @@ public:
       }
    }
 
+   /**
+    * Records the time spent in every action executed by the system contract, keyed by action name,
+    * for as long as the sampler is alive. Used by the benchmark test cases.
+    */
+   struct action_cpu_sampler {
+      std::map<action_name, std::vector<int64_t>> samples;
+      boost::signals2::scoped_connection          conn;
+
+      explicit action_cpu_sampler( controller& control ) {
+         conn = control.applied_transaction.connect(
+            [this]( std::tuple<const transaction_trace_ptr&, const signed_transaction&> p ) {
+               const auto& t = std::get<0>(p);
+               if( !t->receipt || t->receipt->status != transaction_receipt::executed ) return;
+               for( const auto& at : t->action_traces ) {
+                  if( at.receiver == config::system_account_name && at.act.account == config::system_account_name )
+                     samples[at.act.name].push_back( at.elapsed.count() );
+               }
+            } );
+      }
+
+      /// median of the samples collected for an action, in microseconds
+      int64_t median( action_name act ) const {
+         auto itr = samples.find( act );
+         if( itr == samples.end() || itr->second.empty() ) return 0;
+         auto v = itr->second;
+         std::nth_element( v.begin(), v.begin() + v.size() / 2, v.end() );
+         return v[v.size() / 2];
+      }
+
+      void clear() { samples.clear(); }
+   };
+
    abi_serializer abi_ser;
    abi_serializer token_abi_ser;
 };
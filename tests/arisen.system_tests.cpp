@@ -3,9 +3,16 @@
 #include <arisen/chain/global_property_object.hpp>
 #include <arisen/chain/resource_limits.hpp>
 #include <arisen/chain/wast_to_wasm.hpp>
+#include <arisen.system/bancor.hpp>
+#include <arisen.system/producer_pay.hpp>
+#include <arisen.system/producer_schedule.hpp>
+#include <arisen.system/vote_weight.hpp>
+#include <cmath>
 #include <cstdlib>
 #include <iostream>
+#include <random>
 #include <sstream>
+#include <tuple>
 #include <fc/log/logger.hpp>
 #include <arisen/chain/exceptions.hpp>
 #include <Runtime/Runtime.h>
@@ -173,6 +180,104 @@ BOOST_FIXTURE_TEST_CASE( buysell, arisen_system_tester ) try {
 
 } FC_LOG_AND_RETHROW()
 
+BOOST_FIXTURE_TEST_CASE( buy_ram_batch, arisen_system_tester ) try {
+
+   auto get_ram_market = [this]() -> fc::variant {
+      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name,
+                                              N(rammarket), symbol{SY(4,RAMCORE)}.value() );
+      BOOST_REQUIRE( !data.empty() );
+      return abi_ser.binary_to_variant("exchange_state", data, abi_serializer_max_time);
+   };
+   auto ram_bytes = [this]( const account_name& a ) { return get_total_stake( a )["ram_bytes"].as_uint64(); };
+   const asset zero = core_sym::from_string("0.0000");
+
+   transfer( "arisen", "alice1111111", core_sym::from_string("1000.0000"), "arisen" );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("no purchases specified"), buyrambatch( "alice1111111", {} ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("receiver account does not exist"),
+                        buyrambatch( "alice1111111", { mvo()("receiver", "nobody111111")("bytes", 0)("quant", core_sym::from_string("1.0000")) } ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("each purchase must specify either bytes or a quantity"),
+                        buyrambatch( "alice1111111", { mvo()("receiver", "bob111111111")("bytes", 1024)("quant", core_sym::from_string("1.0000")) } ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("cannot purchase a negative amount of bytes"),
+                        buyrambatch( "alice1111111", { mvo()("receiver", "bob111111111")("bytes", -1)("quant", core_sym::from_string("1.0000")) } ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("must purchase a positive amount"),
+                        buyrambatch( "alice1111111", { mvo()("receiver", "bob111111111")("bytes", 0)("quant", zero) } ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("must buy ram with core token"),
+                        buyrambatch( "alice1111111", { mvo()("receiver", "bob111111111")("bytes", 0)("quant", asset::from_string("1.0000 TKN")) } ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("must transfer positive quantity"),
+                        buyrambatch( "alice1111111", { mvo()("receiver", "carol1111111")("bytes", 0)("quant", core_sym::from_string("0.0001")) } ) );
+
+   // one transfer and one fee for the whole batch, the bytes split in proportion to the tokens
+   {
+      const uint64_t bob0   = ram_bytes( "bob111111111" );
+      const uint64_t carol0 = ram_bytes( "carol1111111" );
+      const asset initial_ram_balance    = get_balance(N(arisen.ram));
+      const asset initial_ramfee_balance = get_balance(N(arisen.rfee));
+
+      auto market = get_ram_market();
+      const asset r0 = market["base"].as<connector>().balance;
+      const asset e0 = market["quote"].as<connector>().balance;
+
+      BOOST_REQUIRE_EQUAL( success(), buyrambatch( "alice1111111", {
+         mvo()("receiver", "bob111111111")("bytes", 0)("quant", core_sym::from_string("100.0000")),
+         mvo()("receiver", "carol1111111")("bytes", 0)("quant", core_sym::from_string("300.0000"))
+      } ) );
+      BOOST_REQUIRE_EQUAL( core_sym::from_string("600.0000"), get_balance( "alice1111111" ) );
+      BOOST_REQUIRE_EQUAL( initial_ram_balance + core_sym::from_string("398.0000"), get_balance(N(arisen.ram)) );
+      BOOST_REQUIRE_EQUAL( initial_ramfee_balance + core_sym::from_string("2.0000"), get_balance(N(arisen.rfee)) );
+
+      const uint64_t bob_bytes   = ram_bytes( "bob111111111" ) - bob0;
+      const uint64_t carol_bytes = ram_bytes( "carol1111111" ) - carol0;
+      const double net_payment = core_sym::from_string("398.0000").get_amount();
+      const int64_t expected_delta = net_payment * r0.get_amount() / ( net_payment + e0.get_amount() );
+      BOOST_REQUIRE_EQUAL( expected_delta, bob_bytes + carol_bytes );
+      BOOST_REQUIRE_EQUAL( (bob_bytes + carol_bytes) / 4, bob_bytes );
+   }
+
+   // purchases in bytes are priced together like buyrambytes and get the bytes they ask for
+   {
+      transfer( "arisen", "alice1111111", core_sym::from_string("100000.0000"), "arisen" );
+      const uint64_t bob0 = ram_bytes( "bob111111111" );
+      BOOST_REQUIRE_EQUAL( success(), buyrambatch( "alice1111111", { mvo()("receiver", "bob111111111")("bytes", 1024)("quant", zero) } ) );
+      BOOST_REQUIRE( within_one( 1024, ram_bytes( "bob111111111" ) - bob0 ) );
+
+      const uint64_t bob1   = ram_bytes( "bob111111111" );
+      const uint64_t carol1 = ram_bytes( "carol1111111" );
+      BOOST_REQUIRE_EQUAL( success(), buyrambatch( "alice1111111", {
+         mvo()("receiver", "bob111111111")("bytes", 100 * 1024)("quant", zero),
+         mvo()("receiver", "carol1111111")("bytes", 300 * 1024)("quant", zero)
+      } ) );
+      BOOST_REQUIRE( within_one( 100 * 1024, ram_bytes( "bob111111111" ) - bob1 ) );
+      BOOST_REQUIRE( within_one( 300 * 1024, ram_bytes( "carol1111111" ) - carol1 ) );
+
+      const uint64_t bob2   = ram_bytes( "bob111111111" );
+      const uint64_t carol2 = ram_bytes( "carol1111111" );
+      BOOST_REQUIRE_EQUAL( success(), buyrambatch( "alice1111111", {
+         mvo()("receiver", "bob111111111")("bytes", 2048)("quant", zero),
+         mvo()("receiver", "carol1111111")("bytes", 0)("quant", core_sym::from_string("10.0000"))
+      } ) );
+      BOOST_REQUIRE_EQUAL( 2048, ram_bytes( "bob111111111" ) - bob2 );
+      BOOST_REQUIRE( 0 < ram_bytes( "carol1111111" ) - carol2 );
+   }
+
+   // the smallest quantity buyram accepts is not crowded out by a purchase in bytes of the same batch
+   {
+      const asset small = core_sym::from_string("0.0002");
+      BOOST_REQUIRE_EQUAL( success(), buyram( "alice1111111", "carol1111111", small ) );
+      for( const int64_t bytes : { 1, 7, 1000, 4097, 65537 } ) {
+         const uint64_t bob0   = ram_bytes( "bob111111111" );
+         const uint64_t carol0 = ram_bytes( "carol1111111" );
+         BOOST_REQUIRE_EQUAL( success(), buyrambatch( "alice1111111", {
+            mvo()("receiver", "bob111111111")("bytes", bytes)("quant", zero),
+            mvo()("receiver", "carol1111111")("bytes", 0)("quant", small)
+         } ) );
+         BOOST_REQUIRE_EQUAL( bytes, ram_bytes( "bob111111111" ) - bob0 );
+         BOOST_REQUIRE( 0 < ram_bytes( "carol1111111" ) - carol0 );
+      }
+   }
+
+} FC_LOG_AND_RETHROW()
+
 BOOST_FIXTURE_TEST_CASE( stake_unstake, arisen_system_tester ) try {
    cross_15_percent_threshold();
 
@@ -1081,6 +1186,358 @@ BOOST_FIXTURE_TEST_CASE( vote_for_two_producers, arisen_system_tester, * boost::
 } FC_LOG_AND_RETHROW()
 
 
+BOOST_FIXTURE_TEST_CASE( stake_changes_debounced, arisen_system_tester ) try {
+   create_accounts_with_resources( { N(defproducer1) } );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( "defproducer1" ) );
+   issue_and_transfer( "bob111111111", core_sym::from_string("1000.0000"),  config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("100.0000"), core_sym::from_string("100.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), { N(defproducer1) } ) );
+
+   auto votes   = [&]() { return get_producer_info( "defproducer1" )["total_votes"].as_double(); };
+   auto pending = [&]() {
+      const auto voter = get_voter_info( "bob111111111" );
+      return voter.get_object().contains( "pending_stake" ) ? voter["pending_stake"].as_int64() : 0;
+   };
+   auto setvotedelta = [&]( int64_t min_stake_delta, uint16_t min_stake_delta_bp ) {
+      return push_action( config::system_account_name, N(setvotedelta), mvo()
+                          ("min_stake_delta",    min_stake_delta)
+                          ("min_stake_delta_bp", min_stake_delta_bp) );
+   };
+
+   BOOST_REQUIRE_EQUAL( error("missing authority of arisen"),
+                        push_action( N(bob111111111), N(setvotedelta), mvo()("min_stake_delta", 0)("min_stake_delta_bp", 0) ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("min_stake_delta cannot be negative"), setvotedelta( -1, 0 ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("min_stake_delta_bp cannot exceed 10000"), setvotedelta( 0, 10001 ) );
+
+   // by default every stake change is cast right away
+   double cast = votes();
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("0.0001"), core_sym::from_string("0.0000") ) );
+   BOOST_REQUIRE( cast < votes() );
+   BOOST_REQUIRE_EQUAL( 0, pending() );
+
+   // changes below both 10.0000 and 1% of the voted stake are accumulated
+   BOOST_REQUIRE_EQUAL( success(), setvotedelta( 10'0000, 100 ) );
+   BOOST_REQUIRE_EQUAL( 10'0000, get_global_record()["vote_debounce"]["min_stake_delta"].as_int64() );
+   cast = votes();
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("0.5000"), core_sym::from_string("0.5000") ) );
+   BOOST_REQUIRE_EQUAL( cast, votes() );
+   BOOST_REQUIRE_EQUAL( 1'0000, pending() );
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("0.4000"), core_sym::from_string("0.4000") ) );
+   BOOST_REQUIRE_EQUAL( cast, votes() );
+   BOOST_REQUIRE_EQUAL( 1'8000, pending() );
+
+   // and cast together once they reach one of the thresholds
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("0.3000"), core_sym::from_string("0.0000") ) );
+   BOOST_REQUIRE( cast < votes() );
+   BOOST_REQUIRE_EQUAL( 0, pending() );
+
+   // or when the voter votes again
+   cast = votes();
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("0.1000"), core_sym::from_string("0.0000") ) );
+   BOOST_REQUIRE_EQUAL( cast, votes() );
+   BOOST_REQUIRE_EQUAL( 1000, pending() );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), { N(defproducer1) } ) );
+   BOOST_REQUIRE( cast < votes() );
+   BOOST_REQUIRE_EQUAL( 0, pending() );
+
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( proxied_stake_changes_batched, arisen_system_tester ) try {
+   active_and_vote_producers();
+   issue_and_transfer( "bob111111111",  core_sym::from_string("1000.0000"), config::system_account_name );
+   issue_and_transfer( "carol1111111", core_sym::from_string("1000.0000"), config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("100.0000"), core_sym::from_string("100.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), stake( "carol1111111", core_sym::from_string("100.0000"), core_sym::from_string("100.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(bob111111111), N(regproxy), mvo()("proxy", "bob111111111")("isproxy", true) ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), { N(defproducera) } ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(carol1111111), vector<account_name>(), N(bob111111111) ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(setvotedelta), mvo()
+                                                ("min_stake_delta", 0)("min_stake_delta_bp", 100) ) );
+
+   auto votes   = [&]() { return get_producer_info( "defproducera" )["total_votes"].as_double(); };
+   auto pending = [&]() {
+      return !get_row_by_account( config::system_account_name, config::system_account_name, N(pendproxies), N(bob111111111) ).empty();
+   };
+   auto flushproxies = [&]() {
+      return push_action( N(alice1111111), N(flushproxies), mvo()("user", "alice1111111")("max", 10) );
+   };
+
+   // a stake change that the voter casts but that stays below 1% of the proxy's weight accumulates on the proxy
+   const double cast = votes();
+   const double proxied = get_voter_info( "bob111111111" )["proxied_vote_weight"].as_double();
+   BOOST_REQUIRE_EQUAL( success(), stake( "carol1111111", core_sym::from_string("1.5000"), core_sym::from_string("1.5000") ) );
+   BOOST_REQUIRE_EQUAL( cast, votes() );
+   BOOST_REQUIRE( proxied < get_voter_info( "bob111111111" )["proxied_vote_weight"].as_double() );
+   BOOST_REQUIRE( pending() );
+
+   // and are cast in one pass by flushproxies
+   BOOST_REQUIRE_EQUAL( success(), flushproxies() );
+   BOOST_REQUIRE( cast < votes() );
+   BOOST_REQUIRE( !pending() );
+   BOOST_REQUIRE_EQUAL( "0", get_voter_info( "bob111111111" )["pending_proxied_weight"].as_string() );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("no proxies with pending vote weight"), flushproxies() );
+
+   // or before the next election
+   const double flushed = votes();
+   BOOST_REQUIRE_EQUAL( success(), stake( "carol1111111", core_sym::from_string("1.5000"), core_sym::from_string("1.5000") ) );
+   BOOST_REQUIRE_EQUAL( flushed, votes() );
+   BOOST_REQUIRE( pending() );
+   produce_blocks( 250 );
+   BOOST_REQUIRE( flushed < votes() );
+   BOOST_REQUIRE( !pending() );
+
+   // a change that reaches the threshold is cast right away
+   const double elected = votes();
+   BOOST_REQUIRE_EQUAL( success(), stake( "carol1111111", core_sym::from_string("10.0000"), core_sym::from_string("10.0000") ) );
+   BOOST_REQUIRE( elected < votes() );
+   BOOST_REQUIRE( !pending() );
+
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( vote_sets_shared_by_voters, arisen_system_tester ) try {
+   create_accounts_with_resources( { N(defproducer1), N(defproducer2) } );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( "defproducer1", 1 ) );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( "defproducer2", 2 ) );
+   issue_and_transfer( "bob111111111",  core_sym::from_string("1000.0000"), config::system_account_name );
+   issue_and_transfer( "carol1111111", core_sym::from_string("1000.0000"), config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("100.0000"), core_sym::from_string("100.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), stake( "carol1111111", core_sym::from_string("100.0000"), core_sym::from_string("100.0000") ) );
+
+   // voters of the same producers share one vote set
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), { N(defproducer1), N(defproducer2) } ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(carol1111111), { N(defproducer1), N(defproducer2) } ) );
+   const uint64_t set_id = get_voter_info( "bob111111111" )["vote_set_id"].as_uint64();
+   BOOST_REQUIRE( set_id != 0 );
+   BOOST_REQUIRE_EQUAL( set_id, get_voter_info( "carol1111111" )["vote_set_id"].as_uint64() );
+   BOOST_REQUIRE_EQUAL( 2, get_vote_set( set_id )["voters"].as_uint64() );
+   BOOST_REQUIRE_EQUAL( 2, get_voter_info( "bob111111111" )["producers"].get_array().size() );
+
+   auto votes   = [&]( const account_name& p ) { return get_producer_info( p )["total_votes"].as_double(); };
+   auto pending = [&]() {
+      return !get_row_by_account( config::system_account_name, config::system_account_name, N(pendvotesets), account_name(set_id) ).empty();
+   };
+   auto flushvotesets = [&]() {
+      return push_action( N(alice1111111), N(flushvotesets), mvo()("user", "alice1111111")("max", 10) );
+   };
+
+   // a stake change that reaches 1% of the voter's stake but not 1% of the set's weight stays with the set
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(setvotedelta), mvo()
+                                                ("min_stake_delta", 0)("min_stake_delta_bp", 100) ) );
+   const double cast = votes( N(defproducer1) );
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("1.5000"), core_sym::from_string("1.5000") ) );
+   BOOST_REQUIRE_EQUAL( cast, votes( N(defproducer1) ) );
+   BOOST_REQUIRE( pending() );
+
+   // and is cast for all of its producers by flushvotesets
+   BOOST_REQUIRE_EQUAL( success(), flushvotesets() );
+   BOOST_REQUIRE( cast < votes( N(defproducer1) ) );
+   BOOST_REQUIRE_EQUAL( votes( N(defproducer1) ), votes( N(defproducer2) ) );
+   BOOST_REQUIRE( !pending() );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("no vote sets with pending vote weight"), flushvotesets() );
+
+   // or when a voter leaves the set
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("1.5000"), core_sym::from_string("1.5000") ) );
+   BOOST_REQUIRE( pending() );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(carol1111111), { N(defproducer1) } ) );
+   BOOST_REQUIRE( !pending() );
+   BOOST_REQUIRE_EQUAL( 1, get_vote_set( set_id )["voters"].as_uint64() );
+   BOOST_REQUIRE_EQUAL( get_voter_info( "bob111111111" )["fixed_last_vote_weight"].as_string(),
+                        get_producer_info( "defproducer2" )["fixed_total_votes"].as_string() );
+
+   // the set is removed with its last voter and nothing is left behind
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), vector<account_name>() ) );
+   BOOST_REQUIRE( get_vote_set( set_id ).is_null() );
+   BOOST_REQUIRE_EQUAL( 0, get_voter_info( "bob111111111" )["vote_set_id"].as_uint64() );
+   BOOST_REQUIRE_EQUAL( 0, votes( N(defproducer2) ) );
+   BOOST_REQUIRE_EQUAL( get_voter_info( "carol1111111" )["fixed_last_vote_weight"].as_string(),
+                        get_producer_info( "defproducer1" )["fixed_total_votes"].as_string() );
+
+   // the voter that creates a set pays for it, until it leaves and another voter of the set takes it over
+   const uint64_t carol_set = get_voter_info( "carol1111111" )["vote_set_id"].as_uint64();
+   BOOST_REQUIRE_EQUAL( "carol1111111", get_vote_set( carol_set )["payer"].as_string() );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), { N(defproducer1) } ) );
+   BOOST_REQUIRE_EQUAL( "carol1111111", get_vote_set( carol_set )["payer"].as_string() );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(carol1111111), { N(defproducer2) } ) );
+   BOOST_REQUIRE_EQUAL( "", get_vote_set( carol_set )["payer"].as_string() );
+   auto rlm = control->get_resource_limits_manager();
+   const auto carol_ram = rlm.get_account_ram_usage( N(carol1111111) );
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("10.0000"), core_sym::from_string("10.0000") ) );
+   BOOST_REQUIRE_EQUAL( "bob111111111", get_vote_set( carol_set )["payer"].as_string() );
+   BOOST_REQUIRE( rlm.get_account_ram_usage( N(carol1111111) ) < carol_ram );
+
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( vote_weights_are_exact, arisen_system_tester ) try {
+   create_accounts_with_resources( { N(defproducer1), N(defproducer2), N(defproducer3) } );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( "defproducer1", 1 ) );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( "defproducer2", 2 ) );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( "defproducer3", 3 ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(alice1111111), N(regproxy), mvo()
+                                                ("proxy",  "alice1111111")
+                                                ("isproxy", true)
+                        )
+   );
+
+   issue_and_transfer( "alice1111111", core_sym::from_string("1000.0000"),  config::system_account_name );
+   issue_and_transfer( "bob111111111", core_sym::from_string("1000.0000"),  config::system_account_name );
+   issue_and_transfer( "carol1111111", core_sym::from_string("1000.0000"),  config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "alice1111111", core_sym::from_string("13.5791"), core_sym::from_string("7.3313") ) );
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("101.0101"), core_sym::from_string("3.0007") ) );
+   BOOST_REQUIRE_EQUAL( success(), stake( "carol1111111", core_sym::from_string("77.7777"), core_sym::from_string("0.0001") ) );
+
+   BOOST_REQUIRE_EQUAL( success(), vote( N(carol1111111), { N(defproducer1), N(defproducer2), N(defproducer3) } ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), vector<account_name>(), N(alice1111111) ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(alice1111111), { N(defproducer1), N(defproducer3) } ) );
+
+   // stake changes spread over several weeks propagate through the proxy with a different multiplier each time
+   for( int i = 0; i < 4; ++i ) {
+      produce_block( fc::days(9) );
+      BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("1.1111"), core_sym::from_string("0.0003") ) );
+      BOOST_REQUIRE_EQUAL( success(), stake( "carol1111111", core_sym::from_string("0.0007"), core_sym::from_string("2.2222") ) );
+      BOOST_REQUIRE_EQUAL( success(), vote( N(carol1111111), { N(defproducer2), N(defproducer3) } ) );
+      BOOST_REQUIRE_EQUAL( success(), vote( N(carol1111111), { N(defproducer1), N(defproducer2), N(defproducer3) } ) );
+   }
+   BOOST_REQUIRE( 0 < get_producer_info( "defproducer1" )["total_votes"].as_double() );
+   BOOST_REQUIRE( 0 < get_global_state()["total_producer_vote_weight"].as_double() );
+
+   // once every vote is withdrawn nothing is left behind by rounding
+   BOOST_REQUIRE_EQUAL( success(), vote( N(carol1111111), vector<account_name>() ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), vector<account_name>() ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(alice1111111), vector<account_name>() ) );
+   BOOST_REQUIRE_EQUAL( 0, get_voter_info( "alice1111111" )["proxied_vote_weight"].as_double() );
+   BOOST_REQUIRE_EQUAL( 0, get_producer_info( "defproducer1" )["total_votes"].as_double() );
+   BOOST_REQUIRE_EQUAL( 0, get_producer_info( "defproducer2" )["total_votes"].as_double() );
+   BOOST_REQUIRE_EQUAL( 0, get_producer_info( "defproducer3" )["total_votes"].as_double() );
+   BOOST_REQUIRE_EQUAL( 0, get_global_state()["total_producer_vote_weight"].as_double() );
+
+} FC_LOG_AND_RETHROW()
+
+
+BOOST_FIXTURE_TEST_CASE( revote_touches_only_changed_producers, arisen_system_tester ) try {
+   const std::vector<account_name> producers = { N(defproducer1), N(defproducer2), N(defproducer3), N(defproducer4) };
+   create_accounts_with_resources( producers );
+   for( const auto& p : producers ) {
+      BOOST_REQUIRE_EQUAL( success(), regproducer( p ) );
+   }
+
+   issue_and_transfer( "carol1111111", core_sym::from_string("1000.0000"),  config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "carol1111111", core_sym::from_string("50.0000"), core_sym::from_string("50.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(carol1111111), { N(defproducer1), N(defproducer2), N(defproducer3) } ) );
+   produce_block( fc::hours(1) );
+
+   auto last_update = [&]( const account_name& p ) {
+      return get_producer_info2( p )["last_votepay_share_update"].as_string();
+   };
+   const auto update1 = last_update( N(defproducer1) );
+   const auto update2 = last_update( N(defproducer2) );
+   const auto update3 = last_update( N(defproducer3) );
+   const double votes = get_producer_info( "defproducer1" )["total_votes"].as_double();
+
+   // replacing one producer only modifies the producer that lost the vote and the one that gained it
+   BOOST_REQUIRE_EQUAL( success(), vote( N(carol1111111), { N(defproducer1), N(defproducer2), N(defproducer4) } ) );
+   BOOST_REQUIRE_EQUAL( update1, last_update( N(defproducer1) ) );
+   BOOST_REQUIRE_EQUAL( update2, last_update( N(defproducer2) ) );
+   BOOST_REQUIRE( update3 != last_update( N(defproducer3) ) );
+   BOOST_REQUIRE_EQUAL( votes, get_producer_info( "defproducer1" )["total_votes"].as_double() );
+   BOOST_REQUIRE_EQUAL( votes, get_producer_info( "defproducer4" )["total_votes"].as_double() );
+   BOOST_REQUIRE_EQUAL( 0, get_producer_info( "defproducer3" )["total_votes"].as_double() );
+
+   // an unchanged vote for a producer that has been unregistered in the meantime is still rejected
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(defproducer2), N(unregprod), mvo()("producer", "defproducer2") ) );
+   produce_block();
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "producer defproducer2 is not currently registered" ),
+                        vote( N(carol1111111), { N(defproducer1), N(defproducer2), N(defproducer4) } ) );
+
+} FC_LOG_AND_RETHROW()
+
+
+BOOST_FIXTURE_TEST_CASE( votepay_kept_in_producer_row, arisen_system_tester ) try {
+   const std::vector<account_name> producers = { N(defproducer1), N(defproducer2) };
+   create_accounts_with_resources( producers );
+   for( const auto& p : producers ) {
+      BOOST_REQUIRE_EQUAL( success(), regproducer( p ) );
+      BOOST_REQUIRE( get_producer_info( p ).get_object().contains( "votepay" ) );
+      BOOST_REQUIRE( get_producer_info2_row( p ).is_null() );
+   }
+
+   issue_and_transfer( "carol1111111", core_sym::from_string("1000.0000"),  config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "carol1111111", core_sym::from_string("50.0000"), core_sym::from_string("50.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(carol1111111), { N(defproducer1), N(defproducer2) } ) );
+   const auto update = get_producer_info2( N(defproducer1) )["last_votepay_share_update"].as_string();
+   produce_block( fc::hours(1) );
+
+   // votes settle the votepay shares in the producer row and never create the separate row
+   BOOST_REQUIRE_EQUAL( success(), vote( N(carol1111111), { N(defproducer2) } ) );
+   const auto info = get_producer_info2( N(defproducer1) );
+   BOOST_REQUIRE( update != info["last_votepay_share_update"].as_string() );
+   BOOST_REQUIRE( 0 < info["votepay_share"].as_double() );
+   // the global total has accrued the shares of both producers without visiting defproducer2
+   BOOST_REQUIRE_EQUAL( 2 * info["votepay_share"].as_double(), get_global_state2()["total_producer_votepay_share"].as_double() );
+   for( const auto& p : producers ) {
+      BOOST_REQUIRE( get_producer_info2_row( p ).is_null() );
+   }
+
+} FC_LOG_AND_RETHROW()
+
+
+BOOST_AUTO_TEST_CASE( bulkvote_matches_voteproducer ) try {
+   const std::vector<account_name> producers = { N(defproducer1), N(defproducer2), N(defproducer3), N(defproducer4) };
+   auto setup = [&]( arisen_system_tester& t ) {
+      t.create_accounts_with_resources( producers );
+      for( const auto& p : producers ) {
+         BOOST_REQUIRE_EQUAL( t.success(), t.regproducer( p ) );
+      }
+      BOOST_REQUIRE_EQUAL( t.success(), t.push_action( N(alice1111111), N(regproxy), mvo()("proxy", "alice1111111")("isproxy", true) ) );
+      for( const auto& v : { N(alice1111111), N(bob111111111), N(carol1111111) } ) {
+         t.issue_and_transfer( v, core_sym::from_string("1000.0000"), config::system_account_name );
+      }
+      BOOST_REQUIRE_EQUAL( t.success(), t.stake( "alice1111111", core_sym::from_string("13.5791"), core_sym::from_string("7.3313") ) );
+      BOOST_REQUIRE_EQUAL( t.success(), t.stake( "bob111111111", core_sym::from_string("101.0101"), core_sym::from_string("3.0007") ) );
+      BOOST_REQUIRE_EQUAL( t.success(), t.stake( "carol1111111", core_sym::from_string("77.7777"), core_sym::from_string("0.0001") ) );
+      BOOST_REQUIRE_EQUAL( t.success(), t.vote( N(carol1111111), { N(defproducer1), N(defproducer2), N(defproducer3) } ) );
+      BOOST_REQUIRE_EQUAL( t.success(), t.vote( N(bob111111111), { N(defproducer2), N(defproducer4) } ) );
+      // producers cross the claim threshold, so the batch also resets their votepay shares
+      t.produce_block( fc::days(4) );
+   };
+
+   // the last vote reverts the first one, which cancels out on defproducer4
+   const std::vector<mvo> votes = {
+      mvo()("voter", "carol1111111")("proxy", name(0))("producers", std::vector<account_name>{ N(defproducer1), N(defproducer2), N(defproducer4) }),
+      mvo()("voter", "bob111111111")("proxy", "alice1111111")("producers", std::vector<account_name>{}),
+      mvo()("voter", "alice1111111")("proxy", name(0))("producers", std::vector<account_name>{ N(defproducer1), N(defproducer3) }),
+      mvo()("voter", "carol1111111")("proxy", name(0))("producers", std::vector<account_name>{ N(defproducer1), N(defproducer2), N(defproducer3) })
+   };
+
+   arisen_system_tester sequential;
+   setup( sequential );
+   for( const auto& v : votes ) {
+      BOOST_REQUIRE_EQUAL( sequential.success(), sequential.push_action( v["voter"].as<account_name>(), N(voteproducer), v ) );
+   }
+
+   arisen_system_tester bulk;
+   setup( bulk );
+   BOOST_REQUIRE_EQUAL( bulk.success(), bulk.bulkvote( votes ) );
+
+   for( const auto& p : producers ) {
+      BOOST_REQUIRE_EQUAL( sequential.get_producer_info( p )["total_votes"].as_double(), bulk.get_producer_info( p )["total_votes"].as_double() );
+      BOOST_REQUIRE_EQUAL( sequential.get_producer_info2( p )["votepay_share"].as_double(), bulk.get_producer_info2( p )["votepay_share"].as_double() );
+      BOOST_REQUIRE_EQUAL( sequential.get_producer_info2( p )["last_votepay_share_update"].as_string(),
+                           bulk.get_producer_info2( p )["last_votepay_share_update"].as_string() );
+   }
+   for( const auto& v : { "alice1111111", "bob111111111", "carol1111111" } ) {
+      BOOST_REQUIRE_EQUAL( sequential.get_voter_info( v )["last_vote_weight"].as_double(), bulk.get_voter_info( v )["last_vote_weight"].as_double() );
+      BOOST_REQUIRE_EQUAL( sequential.get_voter_info( v )["proxied_vote_weight"].as_double(), bulk.get_voter_info( v )["proxied_vote_weight"].as_double() );
+   }
+   BOOST_REQUIRE_EQUAL( sequential.get_global_state()["total_producer_vote_weight"].as_double(),
+                        bulk.get_global_state()["total_producer_vote_weight"].as_double() );
+   BOOST_REQUIRE_EQUAL( sequential.get_global_state2()["total_producer_votepay_share"].as_double(),
+                        bulk.get_global_state2()["total_producer_votepay_share"].as_double() );
+   BOOST_REQUIRE_EQUAL( sequential.get_global_state3()["total_vpay_share_change_rate"].as_double(),
+                        bulk.get_global_state3()["total_vpay_share_change_rate"].as_double() );
+
+} FC_LOG_AND_RETHROW()
+
+
 BOOST_FIXTURE_TEST_CASE( proxy_register_unregister_keeps_stake, arisen_system_tester ) try {
    //register proxy by first action for this user ever
    BOOST_REQUIRE_EQUAL( success(), push_action(N(alice1111111), N(regproxy), mvo()
@@ -1431,6 +1888,297 @@ BOOST_FIXTURE_TEST_CASE(producer_pay, arisen_system_tester, * boost::unit_test::
 } FC_LOG_AND_RETHROW()
 
 
+BOOST_FIXTURE_TEST_CASE(unpaid_blocks_buffered_per_round, arisen_system_tester) try {
+   const asset large_asset = core_sym::from_string("80.0000");
+   create_account_with_resources( N(defproducera), config::system_account_name, core_sym::from_string("1.0000"), false, large_asset, large_asset );
+   create_account_with_resources( N(producvotera), config::system_account_name, core_sym::from_string("1.0000"), false, large_asset, large_asset );
+
+   BOOST_REQUIRE_EQUAL(success(), regproducer(N(defproducera)));
+   produce_block(fc::hours(24));
+   transfer( config::system_account_name, "producvotera", core_sym::from_string("400000000.0000"), config::system_account_name);
+   BOOST_REQUIRE_EQUAL(success(), stake("producvotera", core_sym::from_string("100000000.0000"), core_sym::from_string("100000000.0000")));
+   BOOST_REQUIRE_EQUAL(success(), vote( N(producvotera), { N(defproducera) }));
+
+   // defproducera produces every block, its blocks stay in the buffer while it keeps producing
+   produce_blocks(50);
+   const auto buffer = get_unpaid_blocks_buffer();
+   BOOST_REQUIRE_EQUAL( "defproducera", buffer["producer"].as_string() );
+   const uint32_t buffered = buffer["blocks"].as<uint32_t>();
+   BOOST_REQUIRE( 1 < buffered );
+   BOOST_REQUIRE_EQUAL( 0, get_producer_info_row( N(defproducera) )["unpaid_blocks"].as<uint32_t>() );
+   BOOST_REQUIRE_EQUAL( 0, get_global_state_row()["total_unpaid_blocks"].as<uint32_t>() );
+   BOOST_REQUIRE_EQUAL( buffered, get_producer_info( N(defproducera) )["unpaid_blocks"].as<uint32_t>() );
+   BOOST_REQUIRE_EQUAL( buffered, get_global_state()["total_unpaid_blocks"].as<uint32_t>() );
+
+   // claiming rewards pays for the buffered blocks
+   const asset initial_balance = get_balance(N(defproducera));
+   BOOST_REQUIRE_EQUAL(success(), push_action(N(defproducera), N(claimrewards), mvo()("owner", "defproducera")));
+   BOOST_REQUIRE( initial_balance < get_balance(N(defproducera)) );
+   BOOST_REQUIRE_EQUAL( 0, get_producer_info_row( N(defproducera) )["unpaid_blocks"].as<uint32_t>() );
+   BOOST_REQUIRE_EQUAL( 0, get_global_state_row()["total_unpaid_blocks"].as<uint32_t>() );
+   BOOST_REQUIRE( buffered > get_unpaid_blocks_buffer()["blocks"].as<uint32_t>() );
+
+} FC_LOG_AND_RETHROW()
+
+
+BOOST_FIXTURE_TEST_CASE(settle_pay_credits, arisen_system_tester) try {
+   const asset large_asset = core_sym::from_string("80.0000");
+   create_account_with_resources( N(defproducera), config::system_account_name, core_sym::from_string("1.0000"), false, large_asset, large_asset );
+   create_account_with_resources( N(producvotera), config::system_account_name, core_sym::from_string("1.0000"), false, large_asset, large_asset );
+
+   BOOST_REQUIRE_EQUAL(success(), regproducer(N(defproducera)));
+   produce_block(fc::hours(24));
+   transfer( config::system_account_name, "producvotera", core_sym::from_string("400000000.0000"), config::system_account_name);
+   BOOST_REQUIRE_EQUAL(success(), stake("producvotera", core_sym::from_string("100000000.0000"), core_sym::from_string("100000000.0000")));
+   BOOST_REQUIRE_EQUAL(success(), vote( N(producvotera), { N(defproducera) }));
+   produce_blocks(50);
+
+   auto settlepay = [&]( uint16_t max ) {
+      return push_action( N(producvotera), N(settlepay), mvo()("user", "producvotera")("max", max) );
+   };
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("max must be positive"), settlepay( 0 ) );
+
+   // the settlement issues the inflation and credits the pay without transferring it
+   const asset initial_supply  = get_token_supply();
+   const asset initial_balance = get_balance(N(defproducera));
+   const asset initial_bpay    = get_balance(N(arisen.bpay));
+   BOOST_REQUIRE_EQUAL( success(), settlepay( 10 ) );
+   const asset supply = get_token_supply();
+   BOOST_REQUIRE( initial_supply < supply );
+   BOOST_REQUIRE_EQUAL( initial_balance, get_balance(N(defproducera)) );
+   BOOST_REQUIRE( initial_bpay < get_balance(N(arisen.bpay)) );
+   BOOST_REQUIRE_EQUAL( 0, get_producer_info_row( N(defproducera) )["unpaid_blocks"].as<uint32_t>() );
+   BOOST_REQUIRE_EQUAL( false, get_global_record()["payout"]["settling"].as_bool() );
+
+   const auto credit = get_pay_credit( N(defproducera) );
+   BOOST_REQUIRE( !credit.is_null() );
+   const int64_t credited = credit["block_pay"].as_int64() + credit["vote_pay"].as_int64();
+   BOOST_REQUIRE( 0 < credit["block_pay"].as_int64() );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("pay has already been settled within past day"), settlepay( 10 ) );
+
+   // the credit is withdrawn by a claim, which does not issue tokens after a settlement
+   produce_block();
+   BOOST_REQUIRE_EQUAL(success(), push_action(N(defproducera), N(claimrewards), mvo()("owner", "defproducera")));
+   BOOST_REQUIRE_EQUAL( initial_balance.get_amount() + credited, get_balance(N(defproducera)).get_amount() );
+   BOOST_REQUIRE_EQUAL( supply, get_token_supply() );
+   BOOST_REQUIRE( get_pay_credit( N(defproducera) ).is_null() );
+
+   // and there is nothing left to claim until the next day
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("already claimed rewards within past day"),
+                        push_action(N(defproducera), N(claimrewards), mvo()("owner", "defproducera")) );
+
+   // the next day's settlement pays again
+   produce_block(fc::hours(24));
+   produce_blocks(10);
+   BOOST_REQUIRE_EQUAL( success(), settlepay( 10 ) );
+   BOOST_REQUIRE( supply < get_token_supply() );
+   BOOST_REQUIRE( !get_pay_credit( N(defproducera) ).is_null() );
+
+} FC_LOG_AND_RETHROW()
+
+
+BOOST_FIXTURE_TEST_CASE(settle_pay_needs_claims, arisen_system_tester) try {
+   const asset large_asset = core_sym::from_string("80.0000");
+   create_account_with_resources( N(defproducera), config::system_account_name, core_sym::from_string("1.0000"), false, large_asset, large_asset );
+   create_account_with_resources( N(producvotera), config::system_account_name, core_sym::from_string("1.0000"), false, large_asset, large_asset );
+
+   BOOST_REQUIRE_EQUAL(success(), regproducer(N(defproducera)));
+   produce_block(fc::hours(24));
+   transfer( config::system_account_name, "producvotera", core_sym::from_string("400000000.0000"), config::system_account_name);
+   BOOST_REQUIRE_EQUAL(success(), stake("producvotera", core_sym::from_string("100000000.0000"), core_sym::from_string("100000000.0000")));
+   BOOST_REQUIRE_EQUAL(success(), vote( N(producvotera), { N(defproducera) }));
+   produce_blocks(50);
+
+   auto settlepay = [&]() {
+      return push_action( N(producvotera), N(settlepay), mvo()("user", "producvotera")("max", 10) );
+   };
+   auto vote_pay = [&]() {
+      const auto credit = get_pay_credit( N(defproducera) );
+      return credit.is_null() ? 0 : credit["vote_pay"].as_int64();
+   };
+   auto claim_time = [&]() {
+      return microseconds_since_epoch_of_iso_string( get_producer_info( N(defproducera) )["last_claim_time"] );
+   };
+   const auto registered = claim_time();
+
+   // settlements credit the vote pay of a producer that does not claim, but do not count as its claims
+   BOOST_REQUIRE_EQUAL( success(), settlepay() );
+   int64_t credited = vote_pay();
+   BOOST_REQUIRE( 0 < credited );
+   BOOST_REQUIRE_EQUAL( registered, claim_time() );
+   produce_block(fc::hours(24));
+   BOOST_REQUIRE_EQUAL( success(), settlepay() );
+   BOOST_REQUIRE( credited < vote_pay() );
+   BOOST_REQUIRE_EQUAL( registered, claim_time() );
+   credited = vote_pay();
+
+   // 3 days after its last claim the producer stops accruing vote pay, settlements go on without it
+   for( int day = 0; day < 2; ++day ) {
+      produce_block(fc::hours(24));
+      BOOST_REQUIRE_EQUAL( success(), settlepay() );
+      BOOST_REQUIRE_EQUAL( credited, vote_pay() );
+   }
+
+   // until it claims again, which withdraws the credit
+   BOOST_REQUIRE_EQUAL(success(), push_action(N(defproducera), N(claimrewards), mvo()("owner", "defproducera")));
+   BOOST_REQUIRE( get_pay_credit( N(defproducera) ).is_null() );
+   BOOST_REQUIRE( registered < claim_time() );
+   produce_block(fc::hours(24));
+   BOOST_REQUIRE_EQUAL( success(), settlepay() );
+   BOOST_REQUIRE( 0 < vote_pay() );
+
+} FC_LOG_AND_RETHROW()
+
+
+BOOST_FIXTURE_TEST_CASE(claim_rewards_compounding, arisen_system_tester) try {
+   const asset large_asset = core_sym::from_string("80.0000");
+   create_account_with_resources( N(defproducera), config::system_account_name, core_sym::from_string("1.0000"), false, large_asset, large_asset );
+   create_account_with_resources( N(producvotera), config::system_account_name, core_sym::from_string("1.0000"), false, large_asset, large_asset );
+
+   BOOST_REQUIRE_EQUAL(success(), regproducer(N(defproducera)));
+   produce_block(fc::hours(24));
+   transfer( config::system_account_name, "producvotera", core_sym::from_string("400000000.0000"), config::system_account_name);
+   BOOST_REQUIRE_EQUAL(success(), stake("producvotera", core_sym::from_string("100000000.0000"), core_sym::from_string("100000000.0000")));
+   BOOST_REQUIRE_EQUAL(success(), vote( N(producvotera), { N(defproducera) }));
+   produce_blocks(50);
+
+   auto total_stake = [&]( const account_name& act ) {
+      const auto res = get_total_stake( act );
+      return res["net_weight"].as<asset>() + res["cpu_weight"].as<asset>();
+   };
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("cannot use transfer flag if delegating to self"),
+                        push_action( N(defproducera), N(claimtostake), mvo()("owner", "defproducera")("receiver", "defproducera")("transfer", true) ) );
+
+   // the rewards are staked to producvotera without passing through the balance of defproducera
+   const asset initial_balance     = get_balance(N(defproducera));
+   const asset initial_stake       = total_stake( N(producvotera) );
+   const asset initial_stake_funds = get_balance(N(arisen.stake));
+   const int64_t initial_staked    = get_voter_info( N(defproducera) )["staked"].as_int64();
+   BOOST_REQUIRE_EQUAL( success(),
+                        push_action( N(defproducera), N(claimtostake), mvo()("owner", "defproducera")("receiver", "producvotera")("transfer", false) ) );
+   const asset staked = total_stake( N(producvotera) ) - initial_stake;
+   BOOST_REQUIRE( 0 < staked.get_amount() );
+   BOOST_REQUIRE_EQUAL( initial_balance, get_balance(N(defproducera)) );
+   BOOST_REQUIRE_EQUAL( initial_stake_funds + staked, get_balance(N(arisen.stake)) );
+   BOOST_REQUIRE_EQUAL( initial_staked + staked.get_amount(), get_voter_info( N(defproducera) )["staked"].as_int64() );
+   BOOST_REQUIRE_EQUAL( 0, get_producer_info_row( N(defproducera) )["unpaid_blocks"].as<uint32_t>() );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("already claimed rewards within past day"),
+                        push_action( N(defproducera), N(claimtocom), mvo()("owner", "defproducera") ) );
+
+   // a day later the rewards are deposited into the COM fund of defproducera
+   produce_block(fc::hours(24));
+   produce_blocks(10);
+   const asset initial_fund = get_com_fund( N(defproducera) );
+   const asset initial_com_funds = get_balance(N(arisen.com));
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(defproducera), N(claimtocom), mvo()("owner", "defproducera") ) );
+   const asset deposited = get_com_fund( N(defproducera) ) - initial_fund;
+   BOOST_REQUIRE( 0 < deposited.get_amount() );
+   BOOST_REQUIRE_EQUAL( initial_balance, get_balance(N(defproducera)) );
+   BOOST_REQUIRE_EQUAL( initial_com_funds + deposited, get_balance(N(arisen.com)) );
+
+} FC_LOG_AND_RETHROW()
+
+
+// claims of a sampled schedule paid by the contract and by the native model of producer_pay.hpp
+BOOST_FIXTURE_TEST_CASE(producer_pay_matches_native_model, arisen_system_tester) try {
+   using namespace arisensystem;
+   const producer_pay::parameters params{ 0.04879, 5, 4, 100'0000, int64_t(52 * 7 * 24 * 3600) * 1000'000 };
+
+   const asset large_asset = core_sym::from_string("80.0000");
+   const std::vector<account_name> producers = { N(defproducera), N(defproducerb), N(defproducerc) };
+   for( const auto& p : producers ) {
+      create_account_with_resources( p, config::system_account_name, core_sym::from_string("1.0000"), false, large_asset, large_asset );
+      BOOST_REQUIRE_EQUAL( success(), regproducer( p ) );
+   }
+   create_account_with_resources( N(producvotera), config::system_account_name, core_sym::from_string("1.0000"), false, large_asset, large_asset );
+   create_account_with_resources( N(producvoterb), config::system_account_name, core_sym::from_string("1.0000"), false, large_asset, large_asset );
+
+   produce_block(fc::hours(24));
+   transfer( config::system_account_name, "producvotera", core_sym::from_string("400000000.0000"), config::system_account_name);
+   transfer( config::system_account_name, "producvoterb", core_sym::from_string("100000000.0000"), config::system_account_name);
+   BOOST_REQUIRE_EQUAL(success(), stake("producvotera", core_sym::from_string("100000000.0000"), core_sym::from_string("100000000.0000")));
+   BOOST_REQUIRE_EQUAL(success(), stake("producvoterb", core_sym::from_string("20000000.0000"), core_sym::from_string("20000000.0000")));
+   BOOST_REQUIRE_EQUAL(success(), vote( N(producvotera), { N(defproducera), N(defproducerb), N(defproducerc) }));
+   BOOST_REQUIRE_EQUAL(success(), vote( N(producvoterb), { N(defproducera) }));
+   produce_blocks(50);
+
+   auto time_of = [&]( const fc::variant& v ) { return int64_t( microseconds_since_epoch_of_iso_string( v ) ); };
+
+   auto claim = [&]( const account_name& owner ) {
+      const auto gs     = get_global_state();
+      const auto record = get_global_record();
+      const auto prod   = get_producer_info( owner );
+      const bool share_based = get_global_state2()["revision"].as<uint32_t>() > 0;
+
+      producer_pay::buckets b{ gs["perblock_bucket"].as_int64(), gs["pervote_bucket"].as_int64(), gs["total_unpaid_blocks"].as<uint32_t>() };
+      producer_pay::votepay_totals totals{ to_int128( record["vote_totals"]["producer_votepay_share"] ),
+                                           to_int128( record["vote_totals"]["vpay_share_change_rate"] ),
+                                           time_of( record["gstate3"]["last_vpay_state_update"] ) };
+      producer_pay::producer p{ to_int128( prod["fixed_total_votes"] ), prod["unpaid_blocks"].as<uint32_t>(),
+                                time_of( prod["last_claim_time"] ),
+                                { to_int128( prod["votepay"]["fixed_votepay_share"] ), time_of( prod["votepay"]["last_votepay_share_update"] ) } };
+      const int64_t last_fill = time_of( gs["last_pervote_bucket_fill"] );
+      const asset   supply    = get_token_supply();
+      const asset   balance   = get_balance( owner );
+
+      BOOST_REQUIRE_EQUAL( success(), push_action( owner, N(claimrewards), mvo()("owner", owner) ) );
+
+      const int64_t ct = time_of( get_producer_info( owner )["last_claim_time"] );
+      producer_pay::issuance issued;
+      if( last_fill > 0 && ct > last_fill )
+         issued = producer_pay::inflation( params, supply.get_amount(), ct - last_fill );
+      b.perblock_bucket += issued.to_per_block_pay;
+      b.pervote_bucket  += issued.to_per_vote_pay;
+      const auto pay = producer_pay::claim( params, b, totals, p, ct, share_based,
+                                            to_int128( record["vote_totals"]["producer_vote_weight"] ) );
+
+      BOOST_REQUIRE_EQUAL( supply.get_amount() + issued.total, get_token_supply().get_amount() );
+      BOOST_REQUIRE_EQUAL( balance.get_amount() + pay.per_block + pay.per_vote, get_balance( owner ).get_amount() );
+
+      const auto gs_after     = get_global_state();
+      const auto record_after = get_global_record();
+      const auto prod_after   = get_producer_info( owner );
+      BOOST_REQUIRE_EQUAL( b.perblock_bucket,     gs_after["perblock_bucket"].as_int64() );
+      BOOST_REQUIRE_EQUAL( b.pervote_bucket,      gs_after["pervote_bucket"].as_int64() );
+      BOOST_REQUIRE_EQUAL( b.total_unpaid_blocks, gs_after["total_unpaid_blocks"].as<uint32_t>() );
+      BOOST_REQUIRE( totals.share       == to_int128( record_after["vote_totals"]["producer_votepay_share"] ) );
+      BOOST_REQUIRE( totals.change_rate == to_int128( record_after["vote_totals"]["vpay_share_change_rate"] ) );
+      BOOST_REQUIRE( p.votepay.share    == to_int128( prod_after["votepay"]["fixed_votepay_share"] ) );
+      return pay;
+   };
+
+   std::mt19937 gen( 7 );
+   std::uniform_int_distribution<int> extra_minutes( 1, 6 * 60 );
+   std::uniform_int_distribution<int> blocks( 1, 40 );
+   int64_t paid = 0;
+   for( int day = 0; day < 8; ++day ) {
+      // vote pay is split by votepay shares from the fourth day on
+      if( day == 3 ) {
+         BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(updtrevision), mvo()("revision", 1) ) );
+      }
+      // and the vote weights move in between
+      if( day == 5 ) {
+         BOOST_REQUIRE_EQUAL( success(), vote( N(producvoterb), { N(defproducerb) } ) );
+      }
+      produce_block( fc::hours(24) + fc::minutes( extra_minutes(gen) ) );
+      produce_blocks( blocks(gen) );
+      auto order = producers;
+      std::shuffle( order.begin(), order.end(), gen );
+      for( const auto& p : order ) {
+         const auto pay = claim( p );
+         paid += pay.per_block + pay.per_vote;
+         produce_blocks( blocks(gen) );
+      }
+   }
+   BOOST_REQUIRE( 0 < paid );
+
+} FC_LOG_AND_RETHROW()
+
+
 BOOST_FIXTURE_TEST_CASE(multiple_producer_pay, arisen_system_tester, * boost::unit_test::tolerance(1e-10)) try {
 
    const int64_t secs_per_year  = 52 * 7 * 24 * 3600;
@@ -2395,6 +3143,235 @@ BOOST_AUTO_TEST_CASE(votepay_transition2, * boost::unit_test::tolerance(1e-10))
 } FC_LOG_AND_RETHROW()
 
 
+BOOST_AUTO_TEST_CASE(merge_global_state) try {
+   arisen_system_tester t(arisen_system_tester::setup_level::minimal);
+
+   std::string old_contract_core_symbol_name = "RIX"; // Set to core symbol used in contracts::util::system_wasm_old()
+   symbol old_contract_core_symbol{::arisen::chain::string_to_symbol_c( 4, old_contract_core_symbol_name.c_str() )};
+
+   auto old_core_from_string = [&]( const std::string& s ) {
+      return arisen::chain::asset::from_string(s + " " + old_contract_core_symbol_name);
+   };
+
+   // the old contract keeps its global state in the global, global2 and global3 singletons
+   t.create_core_token( old_contract_core_symbol );
+   t.set_code( config::system_account_name, contracts::util::system_wasm_old() );
+   t.set_abi(  config::system_account_name, contracts::util::system_abi_old().data() );
+   {
+      const auto& accnt = t.control->db().get<account_object,by_name>( config::system_account_name );
+      abi_def abi;
+      BOOST_REQUIRE_EQUAL(abi_serializer::to_abi(accnt.abi, abi), true);
+      t.abi_ser.set_abi(abi, arisen_system_tester::abi_serializer_max_time);
+   }
+   const account_name alice = N(alice1111111);
+   t.create_account_with_resources( alice, config::system_account_name, old_core_from_string("1.0000"), false,
+                                    old_core_from_string("10.0000"), old_core_from_string("10.0000") );
+   t.transfer( config::system_account_name, alice, old_core_from_string("1000.0000"), config::system_account_name );
+   t.produce_block();
+
+   t.deploy_contract( false );
+   t.produce_block();
+
+   auto legacy_row = [&]( name table ) {
+      return t.get_row_by_account( config::system_account_name, config::system_account_name, table, table );
+   };
+
+   // until the merge the upgraded contract keeps using the legacy singletons
+   const uint64_t reserved_before = t.get_global_state()["total_ram_bytes_reserved"].as_uint64();
+   BOOST_REQUIRE_EQUAL( t.success(), t.buyram( alice, alice, old_core_from_string("10.0000") ) );
+   BOOST_REQUIRE( t.get_global_record().is_null() );
+   const auto legacy_state = t.get_global_state();
+   BOOST_REQUIRE( reserved_before < legacy_state["total_ram_bytes_reserved"].as_uint64() );
+   const auto legacy_state2 = t.get_global_state2();
+
+   BOOST_REQUIRE_EQUAL( t.error("missing authority of arisen"),
+                        t.push_action( alice, N(mergeglobals), mvo() ) );
+   BOOST_REQUIRE_EQUAL( t.success(), t.push_action( config::system_account_name, N(mergeglobals), mvo() ) );
+   BOOST_REQUIRE_EQUAL( t.wasm_assert_msg("global state has already been merged"),
+                        t.push_action( config::system_account_name, N(mergeglobals), mvo() ) );
+   t.produce_block();
+
+   BOOST_REQUIRE( legacy_row( N(global) ).empty() );
+   BOOST_REQUIRE( legacy_row( N(global2) ).empty() );
+   BOOST_REQUIRE( legacy_row( N(global3) ).empty() );
+
+   const auto record = t.get_global_record();
+   BOOST_REQUIRE( !record.is_null() );
+   BOOST_REQUIRE_EQUAL( 6, record["version"].as_uint64() );
+   BOOST_REQUIRE_EQUAL( legacy_state["total_ram_bytes_reserved"].as_uint64(), record["gstate"]["total_ram_bytes_reserved"].as_uint64() );
+   BOOST_REQUIRE_EQUAL( legacy_state["total_ram_stake"].as_int64(),           record["gstate"]["total_ram_stake"].as_int64() );
+   BOOST_REQUIRE_EQUAL( legacy_state["max_ram_size"].as_uint64(),             record["gstate"]["max_ram_size"].as_uint64() );
+   BOOST_REQUIRE_EQUAL( legacy_state2["last_ram_increase"].as_string(),       record["gstate2"]["last_ram_increase"].as_string() );
+
+   // afterwards the contract reads and writes the consolidated record only
+   BOOST_REQUIRE_EQUAL( t.success(), t.buyram( alice, alice, old_core_from_string("10.0000") ) );
+   BOOST_REQUIRE( legacy_state["total_ram_bytes_reserved"].as_uint64() < t.get_global_state()["total_ram_bytes_reserved"].as_uint64() );
+   BOOST_REQUIRE( legacy_row( N(global) ).empty() );
+
+} FC_LOG_AND_RETHROW()
+
+
+BOOST_AUTO_TEST_CASE(migrate_producers) try {
+   arisen_system_tester t(arisen_system_tester::setup_level::minimal);
+
+   std::string old_contract_core_symbol_name = "RIX"; // Set to core symbol used in contracts::util::system_wasm_old()
+   symbol old_contract_core_symbol{::arisen::chain::string_to_symbol_c( 4, old_contract_core_symbol_name.c_str() )};
+
+   auto old_core_from_string = [&]( const std::string& s ) {
+      return arisen::chain::asset::from_string(s + " " + old_contract_core_symbol_name);
+   };
+
+   // the old contract keeps its producers in the producers and producers2 tables
+   t.create_core_token( old_contract_core_symbol );
+   t.set_code( config::system_account_name, contracts::util::system_wasm_old() );
+   t.set_abi(  config::system_account_name, contracts::util::system_abi_old().data() );
+   {
+      const auto& accnt = t.control->db().get<account_object,by_name>( config::system_account_name );
+      abi_def abi;
+      BOOST_REQUIRE_EQUAL(abi_serializer::to_abi(accnt.abi, abi), true);
+      t.abi_ser.set_abi(abi, arisen_system_tester::abi_serializer_max_time);
+   }
+   const std::vector<account_name> producers = { N(defproducer1), N(defproducer2), N(defproducer3) };
+   for( const auto& p : producers ) {
+      t.create_account_with_resources( p, config::system_account_name, old_core_from_string("1.0000"), false,
+                                       old_core_from_string("10.0000"), old_core_from_string("10.0000") );
+      t.regproducer( p );
+   }
+   t.produce_block();
+
+   t.deploy_contract( false );
+   t.produce_block();
+
+   auto row = [&]( name table, const account_name& p ) {
+      return t.get_row_by_account( config::system_account_name, config::system_account_name, table, p );
+   };
+   for( const auto& p : producers ) {
+      BOOST_REQUIRE( !row( N(producers), p ).empty() );
+      BOOST_REQUIRE( row( N(prodstats), p ).empty() );
+   }
+
+   // a producer is moved over when it is used
+   BOOST_REQUIRE_EQUAL( t.success(), t.push_action( N(defproducer1), N(unregprod), mvo()("producer", "defproducer1") ) );
+   BOOST_REQUIRE( row( N(producers), N(defproducer1) ).empty() );
+   BOOST_REQUIRE( row( N(producers2), N(defproducer1) ).empty() );
+   BOOST_REQUIRE( !row( N(prodstats), N(defproducer1) ).empty() );
+   BOOST_REQUIRE( !row( N(prodconfig), N(defproducer1) ).empty() );
+   BOOST_REQUIRE_EQUAL( fc::crypto::public_key(), fc::crypto::public_key(t.get_producer_info( N(defproducer1) )["producer_key"].as_string()) );
+
+   // the others by migrateprods
+   BOOST_REQUIRE_EQUAL( t.error("missing authority of arisen"),
+                        t.push_action( N(defproducer1), N(migrateprods), mvo()("max_rows", 10) ) );
+   BOOST_REQUIRE_EQUAL( t.success(), t.push_action( config::system_account_name, N(migrateprods), mvo()("max_rows", 1) ) );
+   BOOST_REQUIRE( row( N(producers), N(defproducer2) ).empty() );
+   BOOST_REQUIRE( !row( N(producers), N(defproducer3) ).empty() );
+   t.produce_block();
+   BOOST_REQUIRE_EQUAL( t.success(), t.push_action( config::system_account_name, N(migrateprods), mvo()("max_rows", 10) ) );
+   BOOST_REQUIRE_EQUAL( t.wasm_assert_msg("producers have already been migrated"),
+                        t.push_action( config::system_account_name, N(migrateprods), mvo()("max_rows", 10) ) );
+
+   for( const auto& p : { N(defproducer2), N(defproducer3) } ) {
+      BOOST_REQUIRE( row( N(producers), p ).empty() );
+      BOOST_REQUIRE( row( N(producers2), p ).empty() );
+      const auto info = t.get_producer_info( p );
+      BOOST_REQUIRE_EQUAL( true, info["is_active"].as_bool() );
+      BOOST_REQUIRE_EQUAL( t.get_public_key( p, "active" ), fc::crypto::public_key(info["producer_key"].as_string()) );
+   }
+
+} FC_LOG_AND_RETHROW()
+
+
+BOOST_AUTO_TEST_CASE(migrate_votes) try {
+   arisen_system_tester t(arisen_system_tester::setup_level::minimal);
+
+   std::string old_contract_core_symbol_name = "RIX"; // Set to core symbol used in contracts::util::system_wasm_old()
+   symbol old_contract_core_symbol{::arisen::chain::string_to_symbol_c( 4, old_contract_core_symbol_name.c_str() )};
+
+   auto old_core_from_string = [&]( const std::string& s ) {
+      return arisen::chain::asset::from_string(s + " " + old_contract_core_symbol_name);
+   };
+
+   // the old contract keeps the producers voted for in the voter rows
+   t.create_core_token( old_contract_core_symbol );
+   t.set_code( config::system_account_name, contracts::util::system_wasm_old() );
+   t.set_abi(  config::system_account_name, contracts::util::system_abi_old().data() );
+   {
+      const auto& accnt = t.control->db().get<account_object,by_name>( config::system_account_name );
+      abi_def abi;
+      BOOST_REQUIRE_EQUAL(abi_serializer::to_abi(accnt.abi, abi), true);
+      t.abi_ser.set_abi(abi, arisen_system_tester::abi_serializer_max_time);
+   }
+   const account_name alice = N(alice1111111), bob = N(bob111111111), carol = N(carol1111111);
+   for( const auto& a : { N(defproducer1), N(defproducer2), alice, bob, carol } ) {
+      t.create_account_with_resources( a, config::system_account_name, old_core_from_string("1.0000"), false,
+                                       old_core_from_string("10.0000"), old_core_from_string("10.0000") );
+   }
+   BOOST_REQUIRE_EQUAL( t.success(), t.regproducer( N(defproducer1) ) );
+   BOOST_REQUIRE_EQUAL( t.success(), t.regproducer( N(defproducer2) ) );
+   for( const auto& v : { alice, bob, carol } ) {
+      t.transfer( config::system_account_name, v, old_core_from_string("1000.0000"), config::system_account_name );
+      BOOST_REQUIRE_EQUAL( t.success(), t.stake( v, old_core_from_string("10.0000"), old_core_from_string("10.0000") ) );
+   }
+   BOOST_REQUIRE_EQUAL( t.success(), t.push_action( bob, N(regproxy), mvo()("proxy", bob)("isproxy", true) ) );
+   BOOST_REQUIRE_EQUAL( t.success(), t.vote( alice, { N(defproducer1), N(defproducer2) } ) );
+   BOOST_REQUIRE_EQUAL( t.success(), t.vote( bob,   { N(defproducer1), N(defproducer2) } ) );
+   BOOST_REQUIRE_EQUAL( t.success(), t.vote( carol, { N(defproducer2) } ) );
+   t.produce_block();
+
+   t.deploy_contract( false );
+   t.produce_block();
+
+   const double votes1 = t.get_producer_info( N(defproducer1) )["total_votes"].as_double();
+   const double votes2 = t.get_producer_info( N(defproducer2) )["total_votes"].as_double();
+   const auto legacy_bob = t.get_voter_info( bob );
+   auto row_size = [&]( const name& table, const account_name& v ) {
+      return t.get_row_by_account( config::system_account_name, config::system_account_name, table, v ).size();
+   };
+   const size_t legacy_sizes[] = { row_size( N(voters), alice ), row_size( N(voters), bob ), row_size( N(voters), carol ) };
+   auto vote_set = [&]( const account_name& v ) {
+      const auto voter = t.get_voter_info( v );
+      return voter.get_object().contains( "vote_set_id" ) ? voter["vote_set_id"].as_uint64() : 0;
+   };
+
+   // voter rows are visited in chunks
+   BOOST_REQUIRE_EQUAL( t.error("missing authority of arisen"),
+                        t.push_action( alice, N(migratevotes), mvo()("max_rows", 10) ) );
+   BOOST_REQUIRE_EQUAL( t.success(), t.push_action( config::system_account_name, N(migratevotes), mvo()("max_rows", 1) ) );
+   BOOST_REQUIRE( vote_set( alice ) != 0 );
+   BOOST_REQUIRE_EQUAL( 0, vote_set( bob ) );
+   BOOST_REQUIRE( !t.get_voter_info2( alice ).is_null() );
+   BOOST_REQUIRE( t.get_voter_info2( bob ).is_null() );
+   t.produce_block();
+   BOOST_REQUIRE_EQUAL( t.success(), t.push_action( config::system_account_name, N(migratevotes), mvo()("max_rows", 10) ) );
+   BOOST_REQUIRE_EQUAL( t.wasm_assert_msg("votes have already been migrated"),
+                        t.push_action( config::system_account_name, N(migratevotes), mvo()("max_rows", 10) ) );
+
+   // the rows move into the voters2 table, and none of them grows
+   BOOST_REQUIRE( t.get_row_by_account( config::system_account_name, config::system_account_name, N(voters), bob ).empty() );
+   BOOST_REQUIRE_LE( row_size( N(voters2), alice ), legacy_sizes[0] );
+   BOOST_REQUIRE_LE( row_size( N(voters2), bob ),   legacy_sizes[1] );
+   BOOST_REQUIRE_LE( row_size( N(voters2), carol ), legacy_sizes[2] );
+   const auto bob2 = t.get_voter_info2( bob );
+   BOOST_REQUIRE_EQUAL( 8, bob2["flags"].as_uint64() );
+   BOOST_REQUIRE_EQUAL( legacy_bob["staked"].as_int64(), bob2["staked"].as_int64() );
+   BOOST_REQUIRE_EQUAL( true, t.get_voter_info( bob )["is_proxy"].as_bool() );
+
+   // voters of the same producers share a set, and the producers keep their votes
+   BOOST_REQUIRE_EQUAL( vote_set( alice ), vote_set( bob ) );
+   BOOST_REQUIRE( vote_set( carol ) != 0 && vote_set( carol ) != vote_set( alice ) );
+   BOOST_REQUIRE_EQUAL( 2, t.get_vote_set( vote_set( alice ) )["voters"].as_uint64() );
+   BOOST_REQUIRE_EQUAL( 2, t.get_voter_info( alice )["producers"].get_array().size() );
+   BOOST_REQUIRE_EQUAL( votes1, t.get_producer_info( N(defproducer1) )["total_votes"].as_double() );
+   BOOST_REQUIRE_EQUAL( votes2, t.get_producer_info( N(defproducer2) )["total_votes"].as_double() );
+
+   // a migrated voter leaves its set like any other
+   BOOST_REQUIRE_EQUAL( t.success(), t.vote( bob, { N(defproducer2) } ) );
+   BOOST_REQUIRE_EQUAL( vote_set( bob ), vote_set( carol ) );
+   BOOST_REQUIRE_EQUAL( 1, t.get_vote_set( vote_set( alice ) )["voters"].as_uint64() );
+   BOOST_REQUIRE( t.get_producer_info( N(defproducer1) )["total_votes"].as_double() < votes1 );
+
+} FC_LOG_AND_RETHROW()
+
+
 BOOST_FIXTURE_TEST_CASE(producers_upgrade_system_contract, arisen_system_tester) try {
    //install multisig contract
    abi_serializer msig_abi_ser = initialize_multisig();
@@ -2893,6 +3870,162 @@ BOOST_FIXTURE_TEST_CASE( elect_producers /*_and_parameters*/, arisen_system_test
 } FC_LOG_AND_RETHROW()
 
 
+BOOST_FIXTURE_TEST_CASE( election_skips_unchanged_ranking, arisen_system_tester ) try {
+   active_and_vote_producers();
+   auto election = [&]() { return get_global_record()["election"]; };
+   BOOST_REQUIRE_EQUAL( false, election()["ranking_changed"].as_bool() );
+   const auto digest  = election()["schedule_digest"].as_string();
+   const auto version = control->head_block_state()->active_schedule.version;
+
+   // changes of a producer below the 21 elected ones cannot change the schedule
+   setup_producer_accounts( { N(defproducerv) } );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( N(defproducerv) ) );
+   issue_and_transfer( "bob111111111", core_sym::from_string("2000.0000"),  config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("1000.0000"), core_sym::from_string("1000.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), { N(defproducerv) } ) );
+   BOOST_REQUIRE_EQUAL( false, election()["ranking_changed"].as_bool() );
+
+   // a vote for an elected producer triggers an election, which finds the same schedule
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), { N(defproducera), N(defproducerv) } ) );
+   BOOST_REQUIRE_EQUAL( true, election()["ranking_changed"].as_bool() );
+   produce_blocks( 250 );
+   BOOST_REQUIRE_EQUAL( false, election()["ranking_changed"].as_bool() );
+   BOOST_REQUIRE_EQUAL( digest, election()["schedule_digest"].as_string() );
+   BOOST_REQUIRE_EQUAL( version, control->head_block_state()->active_schedule.version );
+
+   // unregistering an elected producer changes it
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(defproducerb), N(unregprod), mvo()("producer", "defproducerb") ) );
+   BOOST_REQUIRE_EQUAL( true, election()["ranking_changed"].as_bool() );
+   produce_blocks( 250 );
+   BOOST_REQUIRE( digest != election()["schedule_digest"].as_string() );
+   BOOST_REQUIRE( version < control->head_block_state()->active_schedule.version );
+
+} FC_LOG_AND_RETHROW()
+
+
+BOOST_FIXTURE_TEST_CASE( producer_ranking_table, arisen_system_tester ) try {
+   const auto producers = active_and_vote_producers();
+   const std::vector<account_name> elected( producers.begin(), producers.begin() + 21 );
+   // the ranking only holds the names, in name order
+   auto ranked = [&]() {
+      return get_producer_ranking()["producers"].as<std::vector<account_name>>();
+   };
+   auto sorted = []( std::vector<account_name> names ) {
+      std::sort( names.begin(), names.end() );
+      return names;
+   };
+   BOOST_REQUIRE_EQUAL( false, get_producer_ranking()["stale"].as_bool() );
+   BOOST_REQUIRE( sorted( elected ) == ranked() );
+   BOOST_REQUIRE_EQUAL( "0", get_producer_ranking()["outside_votes"].as_string() );
+
+   // ten runner-ups with equal votes fill the ranking, the one last in name order stays outside
+   std::vector<account_name> runnerups;
+   for( char c = 'a'; c < 'a' + 10; ++c ) {
+      runnerups.emplace_back( std::string("runnerup") + c );
+   }
+   setup_producer_accounts( runnerups );
+   for( const auto& p : runnerups ) {
+      BOOST_REQUIRE_EQUAL( success(), regproducer( p ) );
+   }
+   issue_and_transfer( "bob111111111", core_sym::from_string("2000.0000"),  config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("1000.0000"), core_sym::from_string("1000.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), runnerups ) );
+
+   auto expected = elected;
+   expected.insert( expected.end(), runnerups.begin(), runnerups.end() - 1 );
+   BOOST_REQUIRE( sorted( expected ) == ranked() );
+   BOOST_REQUIRE( "0" != get_producer_ranking()["outside_votes"].as_string() );
+   BOOST_REQUIRE_EQUAL( false, get_producer_ranking()["stale"].as_bool() );
+
+   // more votes for ranked producers that stay above the boundary leave the ranking row as it is
+   const auto ranking_row = get_row_by_account( config::system_account_name, config::system_account_name, N(prodranking), N(prodranking) );
+   issue_and_transfer( "carol1111111", core_sym::from_string("2000.0000"),  config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "carol1111111", core_sym::from_string("1000.0000"), core_sym::from_string("1000.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(carol1111111), { elected[0], elected[1] } ) );
+   BOOST_REQUIRE( ranking_row == get_row_by_account( config::system_account_name, config::system_account_name, N(prodranking), N(prodranking) ) );
+
+   // once fewer producers than a schedule needs are ranked, the next election rebuilds the ranking
+   for( size_t i = 0; i < 10; ++i ) {
+      BOOST_REQUIRE_EQUAL( false, get_producer_ranking()["stale"].as_bool() );
+      BOOST_REQUIRE_EQUAL( success(), push_action( elected[i], N(unregprod), mvo()("producer", elected[i]) ) );
+   }
+   BOOST_REQUIRE_EQUAL( true, get_producer_ranking()["stale"].as_bool() );
+   BOOST_REQUIRE_EQUAL( 20, ranked().size() );
+   produce_blocks( 250 );
+
+   BOOST_REQUIRE_EQUAL( false, get_producer_ranking()["stale"].as_bool() );
+   expected.assign( elected.begin() + 10, elected.end() );
+   expected.insert( expected.end(), runnerups.begin(), runnerups.end() );
+   BOOST_REQUIRE( sorted( expected ) == ranked() );
+   BOOST_REQUIRE_EQUAL( "0", get_producer_ranking()["outside_votes"].as_string() );
+
+   const auto schedule = control->head_block_state()->active_schedule.producers;
+   BOOST_REQUIRE_EQUAL( 21, schedule.size() );
+   BOOST_REQUIRE( std::any_of( schedule.begin(), schedule.end(), [&]( const auto& p ) { return p.producer_name == runnerups.back(); } ) );
+
+} FC_LOG_AND_RETHROW()
+
+
+BOOST_FIXTURE_TEST_CASE( schedule_order_by_location, arisen_system_tester ) try {
+   using namespace arisensystem;
+   const auto producers = active_and_vote_producers();
+
+   // spread the elected producers over the location ring in an order unrelated to their names
+   std::map<account_name, uint16_t> locations;
+   for( size_t i = 0; i < 21; ++i ) {
+      const auto location = uint16_t( i * 40503 % producer_schedule::location_ring );
+      locations[producers[i]] = location;
+      BOOST_REQUIRE_EQUAL( success(), push_action( producers[i], N(regproducer), mvo()
+                                                   ("producer",     producers[i])
+                                                   ("producer_key", get_public_key( producers[i], "active" ))
+                                                   ("url",          "")
+                                                   ("location",     location) ) );
+   }
+   produce_blocks( 250 );
+
+   auto schedule = [&]() { return control->head_block_state()->active_schedule.producers; };
+   auto location_of = [&]( const auto& p ) { return locations.at( p.producer_name ); };
+   auto round_length = [&]() {
+      const auto producers = schedule();
+      return producer_schedule::tour_length( producers.begin(), producers.end(), location_of );
+   };
+
+   const auto by_name = schedule();
+   BOOST_REQUIRE_EQUAL( 21, by_name.size() );
+   BOOST_REQUIRE( std::is_sorted( by_name.begin(), by_name.end(),
+                                  []( const auto& a, const auto& b ) { return a.producer_name < b.producer_name; } ) );
+   const uint64_t name_length = round_length();
+
+   BOOST_REQUIRE_EQUAL( error("missing authority of arisen"),
+                        push_action( producers[0], N(setschedord), mvo()("order", 1) ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("unknown schedule order"),
+                        push_action( config::system_account_name, N(setschedord), mvo()("order", 2) ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("schedule order is already set"),
+                        push_action( config::system_account_name, N(setschedord), mvo()("order", 0) ) );
+   BOOST_REQUIRE_EQUAL( success(),
+                        push_action( config::system_account_name, N(setschedord), mvo()("order", 1) ) );
+   BOOST_REQUIRE_EQUAL( 1, get_global_record()["schedule"]["order"].as_uint64() );
+   produce_blocks( 250 );
+
+   const auto by_location = schedule();
+   BOOST_REQUIRE_EQUAL( 21, by_location.size() );
+   BOOST_REQUIRE( std::is_sorted( by_location.begin(), by_location.end(),
+                                  [&]( const auto& a, const auto& b ) { return location_of(a) < location_of(b); } ) );
+   const uint64_t location_length = round_length();
+
+   BOOST_TEST_MESSAGE( "summed handoff distance per round: by name " << name_length << ", by location " << location_length );
+   BOOST_REQUIRE( location_length < name_length );
+   BOOST_REQUIRE( location_length <= producer_schedule::location_ring );
+
+   // switching back proposes the name order again
+   BOOST_REQUIRE_EQUAL( success(),
+                        push_action( config::system_account_name, N(setschedord), mvo()("order", 0) ) );
+   produce_blocks( 250 );
+   BOOST_REQUIRE_EQUAL( name_length, round_length() );
+
+} FC_LOG_AND_RETHROW()
+
+
 BOOST_FIXTURE_TEST_CASE( buyname, arisen_system_tester ) try {
    create_accounts_with_resources( { N(dan), N(sam) } );
    transfer( config::system_account_name, "dan", core_sym::from_string( "10000.0000" ) );
@@ -3100,6 +4233,49 @@ BOOST_FIXTURE_TEST_CASE( namebid_pending_winner, arisen_system_tester ) try {
    create_account_with_resources( N(prefb), N(bob111111111) );
 } FC_LOG_AND_RETHROW()
 
+BOOST_FIXTURE_TEST_CASE( name_auction_mirror, arisen_system_tester ) try {
+   cross_15_percent_threshold();
+   produce_block( fc::hours(14*24) );    //wait 14 day for name auction activation
+   produce_block();
+   transfer( config::system_account_name, N(alice1111111), core_sym::from_string("10000.0000") );
+   transfer( config::system_account_name, N(bob111111111), core_sym::from_string("10000.0000") );
+
+   auto mirror = [&]() { return get_global_record()["name_auction"]; };
+
+   // the name closing check has read the empty index
+   BOOST_REQUIRE_EQUAL( false, mirror()["stale"].as_bool() );
+   BOOST_REQUIRE_EQUAL( 0, mirror()["high_bid"].as_int64() );
+
+   BOOST_REQUIRE_EQUAL( success(), bidname( "alice1111111", "prefa", core_sym::from_string( "50.0000" ) ));
+   BOOST_REQUIRE_EQUAL( "prefa", mirror()["newname"].as_string() );
+   BOOST_REQUIRE_EQUAL( "alice1111111", mirror()["high_bidder"].as_string() );
+   BOOST_REQUIRE_EQUAL( 50'0000, mirror()["high_bid"].as_int64() );
+
+   // a lower bid on another name leaves the mirror alone
+   BOOST_REQUIRE_EQUAL( success(), bidname( "bob111111111", "prefb", core_sym::from_string( "30.0000" ) ));
+   BOOST_REQUIRE_EQUAL( "prefa", mirror()["newname"].as_string() );
+
+   // a higher one replaces it
+   BOOST_REQUIRE_EQUAL( success(), bidname( "alice1111111", "prefb", core_sym::from_string( "60.0000" ) ));
+   BOOST_REQUIRE_EQUAL( "prefb", mirror()["newname"].as_string() );
+   BOOST_REQUIRE_EQUAL( "alice1111111", mirror()["high_bidder"].as_string() );
+   BOOST_REQUIRE_EQUAL( 60'0000, mirror()["high_bid"].as_int64() );
+
+   // closing the auction marks the mirror stale until the next check reads the index
+   produce_block( fc::hours(100) );
+   BOOST_REQUIRE_EQUAL( true, mirror()["stale"].as_bool() );
+   create_account_with_resources( N(prefb), N(alice1111111) );
+
+   produce_block( fc::hours(100) );
+   BOOST_REQUIRE_EQUAL( true, mirror()["stale"].as_bool() );
+   create_account_with_resources( N(prefa), N(alice1111111) );
+
+   // with no open auction left the refreshed mirror is empty
+   produce_block( fc::hours(100) );
+   BOOST_REQUIRE_EQUAL( false, mirror()["stale"].as_bool() );
+   BOOST_REQUIRE_EQUAL( 0, mirror()["high_bid"].as_int64() );
+} FC_LOG_AND_RETHROW()
+
 BOOST_FIXTURE_TEST_CASE( vote_producers_in_and_out, arisen_system_tester ) try {
 
    const asset net = core_sym::from_string("80.0000");
@@ -5171,4 +6347,218 @@ BOOST_FIXTURE_TEST_CASE( buy_pin_sell_ram, arisen_system_tester ) try {
 
 } FC_LOG_AND_RETHROW()
 
+BOOST_AUTO_TEST_CASE( bancor_compat_matches_double ) try {
+   namespace bancor = arisensystem::bancor;
+
+   // the former double precision implementations of exchange_state::get_bancor_output and get_bancor_input
+   auto double_output = []( int64_t inp_reserve, int64_t out_reserve, int64_t inp ) {
+      const double ib = inp_reserve;
+      const double ob = out_reserve;
+      const double in = inp;
+      int64_t out = int64_t( (in * ob) / (ib + in) );
+      return out < 0 ? 0 : out;
+   };
+   auto double_input = []( int64_t out_reserve, int64_t inp_reserve, int64_t out ) {
+      const double ob = out_reserve;
+      const double ib = inp_reserve;
+      int64_t inp = (ib * out) / (ob - out);
+      return inp < 0 ? 0 : inp;
+   };
+
+   // magnitudes spread over the whole int64_t range, fixed seed so that failures are reproducible
+   std::mt19937_64 gen( 20200101 );
+   auto random_amount = [&]() {
+      return int64_t( (gen() >> 1) >> (gen() % 63) );
+   };
+
+   const uint32_t iterations = 2'000'000;
+   for( uint32_t i = 0; i < iterations; ++i ) {
+      const int64_t a = random_amount();
+      const int64_t b = random_amount();
+      const int64_t c = random_amount();
+
+      if( a > 0 && c > 0 && a <= std::numeric_limits<int64_t>::max() - c ) {
+         BOOST_REQUIRE_EQUAL( double_output( a, b, c ), bancor::compat::get_bancor_output( a, b, c ) );
+      }
+      // skip the cases where the double version divides by zero or overflows int64_t
+      if( c < a && double(b) * double(c) / (double(a) - double(c)) < 9e18 ) {
+         BOOST_REQUIRE_EQUAL( double_input( a, b, c ), bancor::compat::get_bancor_input( a, b, c ) );
+      }
+   }
+
+   // quotients that fall just below, on and just above an integer exercise the rounding of the division
+   for( uint32_t i = 0; i < iterations; ++i ) {
+      const int64_t inp         = 1 + gen() % 1000;
+      const int64_t inp_reserve = int64_t( gen() >> (24 + gen() % 40) );
+      const int64_t quotient    = int64_t( gen() >> (4 + gen() % 60) );
+      const __int128 target     = __int128(quotient) * (inp_reserve + inp) + int64_t(gen() % 7) - 3;
+      if( target < 0 || target / inp > std::numeric_limits<int64_t>::max() ) continue;
+      const int64_t out_reserve = int64_t( target / inp );
+      BOOST_REQUIRE_EQUAL( double_output( inp_reserve, out_reserve, inp ),
+                           bancor::compat::get_bancor_output( inp_reserve, out_reserve, inp ) );
+   }
+
+   // negative reserves and amounts, e.g. a COM pool without unlent tokens, give the clamped double result
+   auto fits_int64 = []( double v ) { return std::isfinite( v ) && v > -9e18 && v < 9e18; };
+   for( uint32_t i = 0; i < iterations; ++i ) {
+      const int64_t a = gen() % 3 ? random_amount() : -random_amount();
+      const int64_t b = gen() % 3 ? random_amount() : -random_amount();
+      const int64_t c = gen() % 3 ? random_amount() : -random_amount();
+
+      if( fits_int64( double(c) * double(b) / (double(a) + double(c)) ) ) {
+         BOOST_REQUIRE_EQUAL( double_output( a, b, c ), bancor::compat::get_bancor_output( a, b, c ) );
+      }
+      if( fits_int64( double(b) * double(c) / (double(a) - double(c)) ) ) {
+         BOOST_REQUIRE_EQUAL( double_input( a, b, c ), bancor::compat::get_bancor_input( a, b, c ) );
+      }
+   }
+   BOOST_REQUIRE_EQUAL( 0, bancor::compat::get_bancor_output( -1'000'000, 5'000'000, 10 ) );
+   BOOST_REQUIRE_EQUAL( 0, bancor::compat::get_bancor_output( 1'000'000, 5'000'000, -10 ) );
+   BOOST_REQUIRE_EQUAL( 0, bancor::exact::get_bancor_output( -1'000'000, 5'000'000, 10 ) );
+   BOOST_REQUIRE_EQUAL( 0, bancor::exact::get_bancor_input( 5'000'000, -1'000'000, 10 ) );
+
+   // where the double version trapped, dividing by zero or converting a result beyond int64_t, both fail
+   for( const auto& [a, b, c] : { std::make_tuple( int64_t(5'000'000), int64_t(1'000'000), int64_t(5'000'000) ),
+                                  std::make_tuple( int64_t(3), std::numeric_limits<int64_t>::max(), int64_t(2) ),
+                                  std::make_tuple( int64_t(2), std::numeric_limits<int64_t>::max(), int64_t(1) ) } ) {
+      BOOST_REQUIRE_EQUAL( bancor::overflow, bancor::compat::get_bancor_input( a, b, c ) );
+      BOOST_REQUIRE_EQUAL( bancor::overflow, bancor::exact::get_bancor_input( a, b, c ) );
+   }
+   BOOST_REQUIRE_EQUAL( bancor::overflow, bancor::compat::get_bancor_output( -10, 5'000'000, 10 ) );
+   BOOST_REQUIRE_EQUAL( bancor::overflow, bancor::exact::get_bancor_output( -10, 5'000'000, 10 ) );
+
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE( bancor_exact_is_floor ) try {
+   namespace bancor = arisensystem::bancor;
+
+   std::mt19937_64 gen( 20200102 );
+   auto random_amount = [&]() {
+      return int64_t( (gen() >> 1) >> (gen() % 63) );
+   };
+
+   for( uint32_t i = 0; i < 1'000'000; ++i ) {
+      const int64_t a = random_amount();
+      const int64_t b = random_amount();
+      const int64_t c = random_amount();
+
+      if( a > 0 && c > 0 && a <= std::numeric_limits<int64_t>::max() - c ) {
+         const unsigned __int128 num = (unsigned __int128)(c) * b;
+         const unsigned __int128 den = (unsigned __int128)(a) + c;
+         const unsigned __int128 out = bancor::exact::get_bancor_output( a, b, c );
+         BOOST_REQUIRE( out * den <= num && num < (out + 1) * den );
+         BOOST_REQUIRE( out <= (unsigned __int128)(b) );
+      }
+      if( c < a ) {
+         const unsigned __int128 num = (unsigned __int128)(b) * c;
+         const unsigned __int128 den = (unsigned __int128)(a) - c;
+         if( num / den < (unsigned __int128)(bancor::overflow) ) {
+            const unsigned __int128 inp = bancor::exact::get_bancor_input( a, b, c );
+            BOOST_REQUIRE( inp * den <= num && num < (inp + 1) * den );
+         } else {
+            BOOST_REQUIRE_EQUAL( bancor::overflow, bancor::exact::get_bancor_input( a, b, c ) );
+         }
+      } else if( c == a ) {
+         BOOST_REQUIRE_EQUAL( bancor::overflow, bancor::exact::get_bancor_input( a, b, c ) );
+      } else {
+         // buying more than the reserve holds comes out negative and is clamped, unless it is out of range
+         const unsigned __int128 num = (unsigned __int128)(b) * c;
+         const unsigned __int128 den = (unsigned __int128)(c) - a;
+         BOOST_REQUIRE_EQUAL( num / den < (unsigned __int128)(bancor::overflow) ? 0 : bancor::overflow,
+                              bancor::exact::get_bancor_input( a, b, c ) );
+      }
+   }
+
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE( vote_weight_matches_pow ) try {
+   namespace vote_weight = arisensystem::vote_weight;
+
+   std::mt19937_64 gen( 20200103 );
+   for( uint32_t weeks = 0; weeks < vote_weight::max_years * vote_weight::weeks_per_year; ++weeks ) {
+      for( uint32_t i = 0; i < 100; ++i ) {
+         const int64_t staked   = int64_t( (gen() >> 1) >> (gen() % 63) );
+         const double  expected = double(staked) * std::pow( 2, weeks / double(52) );
+         const double  weight   = vote_weight::to_double( vote_weight::stake_to_weight( staked, weeks ) );
+         // the weight is truncated to an integer, the tolerance covers the rounding of the exponent passed to pow
+         BOOST_REQUIRE( weight <= expected * (1 + 1e-13) );
+         BOOST_REQUIRE( weight >= expected * (1 - 1e-13) - 1 );
+      }
+   }
+
+   // past the covered years the multiplier stays at the one of the last covered week
+   const uint32_t last_week = vote_weight::max_years * vote_weight::weeks_per_year - 1;
+   for( const uint32_t weeks : { last_week + 1, last_week + 52 * 10, std::numeric_limits<uint32_t>::max() } ) {
+      BOOST_REQUIRE( vote_weight::stake_to_weight( 10'000'000'000'000, last_week ) == vote_weight::stake_to_weight( 10'000'000'000'000, weeks ) );
+   }
+
+   BOOST_REQUIRE_EQUAL( 3, vote_weight::pro_rata( 10, 1, 3 ) );
+   BOOST_REQUIRE_EQUAL( 10, vote_weight::pro_rata( 10, 7, 7 ) );
+   BOOST_REQUIRE_EQUAL( 3333333333, vote_weight::pro_rata( 10'000'000'000, __int128(1) << 100, __int128(3) << 100 ) );
+
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( unknown_action, arisen_system_tester ) try {
+   action act;
+   act.account = config::system_account_name;
+   act.name    = N(nosuchaction);
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("unknown action"), base_tester::push_action( std::move(act), N(alice1111111) ) );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE( action_cpu_benchmark ) try {
+   // Reports the median time spent in onblock, voteproducer, buyram, buyrambytes, sellram and deposit, run with
+   // --log_level=message to see the numbers. Set ARISEN_SYSTEM_BASELINE_WASM to a system contract wasm built from
+   // another revision, and ARISEN_SYSTEM_BASELINE_ABI to its abi if it is not next to the wasm, to measure it with
+   // the same actions and compare, e.g. a build with BANCOR_COMPAT_ROUNDING set to 1 or one from before this series.
+   // Each contract runs on its own chain set up from scratch, so that it only sees the tables it writes itself: a
+   // contract from before the table migrations cannot read the migrated global state, producers and voters.
+   auto run = []( arisen_system_tester& t, const char* label ) {
+      t.cross_15_percent_threshold();
+
+      const std::vector<account_name> producers = { N(defproducera), N(defproducerb), N(defproducerc) };
+      t.setup_producer_accounts( producers );
+      for( const auto& p : producers ) {
+         BOOST_REQUIRE_EQUAL( t.success(), t.regproducer( p ) );
+      }
+      const account_name voter = N(alice1111111);
+      t.issue_and_transfer( voter, core_sym::from_string("100000.0000"), config::system_account_name );
+      BOOST_REQUIRE_EQUAL( t.success(), t.stake( voter, core_sym::from_string("10000.0000"), core_sym::from_string("10000.0000") ) );
+      t.produce_block();
+
+      const uint32_t rounds = 50;
+      arisen_system_tester::action_cpu_sampler sampler( *t.control );
+      for( uint32_t i = 0; i < rounds; ++i ) {
+         BOOST_REQUIRE_EQUAL( t.success(), t.vote( voter, i % 2 ? producers : std::vector<account_name>{ producers[0] } ) );
+         BOOST_REQUIRE_EQUAL( t.success(), t.buyram( voter, voter, core_sym::from_string("1.0000") ) );
+         BOOST_REQUIRE_EQUAL( t.success(), t.buyrambytes( voter, voter, 1024 ) );
+         BOOST_REQUIRE_EQUAL( t.success(), t.sellram( voter, 1024 ) );
+         BOOST_REQUIRE_EQUAL( t.success(), t.deposit( voter, core_sym::from_string("1.0000") ) );
+         t.produce_block();
+      }
+      for( auto act : { N(onblock), N(voteproducer), N(buyram), N(buyrambytes), N(sellram), N(deposit) } ) {
+         BOOST_REQUIRE( !sampler.samples[act].empty() );
+         BOOST_TEST_MESSAGE( label << " " << act.to_string() << ": " << sampler.median( act ) << " us (median of "
+                             << sampler.samples[act].size() << ")" );
+      }
+   };
+
+   {
+      arisen_system_tester t;
+      run( t, "current " );
+   }
+
+   if( const char* baseline = std::getenv( "ARISEN_SYSTEM_BASELINE_WASM" ) ) {
+      const char* env_abi = std::getenv( "ARISEN_SYSTEM_BASELINE_ABI" );
+      std::string abi = env_abi ? env_abi : baseline;
+      if( !env_abi && abi.size() > 5 && abi.compare( abi.size() - 5, 5, ".wasm" ) == 0 )
+         abi.replace( abi.size() - 5, 5, ".abi" );
+
+      arisen_system_tester t( arisen_system_tester::setup_level::core_token );
+      t.deploy_contract( read_wasm( baseline ), read_abi( abi.c_str() ) );
+      t.remaining_setup();
+      run( t, "baseline" );
+   }
+
+} FC_LOG_AND_RETHROW()
+
 BOOST_AUTO_TEST_SUITE_END()